@@ -28,16 +28,18 @@ void Game::splash() {
 
 // Load a texture image to be shown as a Splash screen
 void Game::drawSplash() {
-  std::string title = m_easter_egg ? "Truman Escape" : "Flappy Ship";
-  std::string subtitle = "Press Enter to start";
+  const char *title = m_easter_egg ? "Truman Escape" : "Flappy Ship";
   const static auto X_O = m_main_win->m_width * (m_easter_egg ? 0.1 : 0.2);
   const static auto Y_O = m_main_win->m_height - 100;
+  m_txt_title.set(*m_text_big, X_O, Y_O, title);
+  m_txt_subtitle.set(*m_text_renderer, X_O + 100, Y_O - 200,
+                     "Press Enter to start");
   // draw texture and print title
-  m_main_win->textureWindow(m_splash_tex);
-  m_main_win->printOnScreen([&] {
+  m_main_win->textureWindow(m_splash_tex->id());
+  m_main_win->printOnScreen([this] {
     m_env.setColor(agl::WHITE);
-    m_text_big->render(X_O, Y_O, title);
-    m_text_renderer->render(X_O + 100, Y_O - 200, subtitle);
+    m_txt_title.draw();
+    m_txt_subtitle.draw();
   });
 
   // refresh window
@@ -49,40 +51,40 @@ void Game::drawMiniMap() {
   const auto X_O = m_main_win->m_width - 835;
   const auto Y_O = m_main_win->m_height - 500;
 
-  // draw on pixel coords
+  // draw on pixel coords, all the dots in one batch
   m_main_win->printOnScreen([&] {
-    // draw circle
+    auto &batch = m_main_win->batch2d();
+    // draw circle, in the colour of the HUD text
     float map_radius = 50.0f;
     float ratio = map_radius / 100.0f; // sky-to-minimap radius ratio
     int x_sign = -1;
-    m_env.drawCircle(X_O, Y_O, map_radius);
+    batch.circle(X_O, Y_O, map_radius, agl::WHITE);
 
     // draw spaceship dot
     float dot_radius = 3.0f;
-    m_env.setColor(agl::BLACK);
     float ship_x = m_ssh->x() * ratio * x_sign;
     float ship_y = m_ssh->z() * ratio;
-    m_env.drawCircle(X_O - ship_x, Y_O - ship_y, dot_radius);
+    batch.circle(X_O - ship_x, Y_O - ship_y, dot_radius, agl::BLACK);
 
     // draw ring dots
     for (size_t i = 0; i <= m_cur_ring_index; ++i) {
       if (m_cur_ring_index >= m_num_rings) {
         break;
       }
-      auto ring = m_rings.at(i);
-      m_env.setColor(ring.isTriggered() ? agl::RED : agl::GREEN);
+      const auto &ring = m_rings.at(i);
       float ring_x = ring.x() * ratio * x_sign;
       float ring_y = ring.z() * ratio;
-      m_env.drawCircle(X_O - ring_x, Y_O - ring_y, dot_radius);
+      batch.circle(X_O - ring_x, Y_O - ring_y, dot_radius,
+                   ring.isTriggered() ? agl::RED : agl::GREEN);
     }
 
     // draw badcubes dots
     for (size_t i = 0; i < m_num_cubes; ++i) {
-      auto cube = m_cubes.at(i);
-      m_env.setColor(agl::YELLOW);
+      const auto &cube = m_cubes.at(i);
       float cube_x = cube.x() * ratio * x_sign;
       float cube_y = cube.z() * ratio;
-      m_env.drawCircle(X_O - cube_x, Y_O - cube_y, dot_radius - 1.0f);
+      batch.circle(X_O - cube_x, Y_O - cube_y, dot_radius - 1.0f,
+                   agl::YELLOW);
     }
   });
 }
@@ -94,14 +96,19 @@ void Game::drawHUD() {
   const auto Y_O = m_main_win->m_height - 50;
   const static auto offset = 280;
 
+  // the values change a few times per second at most
+  m_txt_fps.setf(*m_text_renderer, X_O, Y_O, "FPS:%2.1f", fps);
+  m_txt_time.setf(*m_text_renderer, X_O + offset, Y_O, "TIME:%2.1fS",
+                  (m_deadline_time / 1000.0));
+  m_txt_rings.setf(*m_text_renderer, X_O + 2 * offset, Y_O, "RINGS: %zu/%zu",
+                   m_cur_ring_index, m_num_rings);
+
   // draw data on the window
-  m_main_win->printOnScreen([&] {
+  m_main_win->printOnScreen([this] {
     m_env.setColor(agl::WHITE);
-    m_text_renderer->renderf(X_O, Y_O, "FPS:%2.1f", fps);
-    m_text_renderer->renderf(X_O + offset, Y_O, "TIME:%2.1fS",
-                             (m_deadline_time / 1000.0));
-    m_text_renderer->renderf(X_O + 2 * offset, Y_O, "RINGS: %d/%d",
-                             m_cur_ring_index, m_num_rings);
+    m_txt_fps.draw();
+    m_txt_time.draw();
+    m_txt_rings.draw();
   });
 
   // draw minimap
@@ -109,28 +116,29 @@ void Game::drawHUD() {
 }
 
 // Draw one on-off setting entry
-void Game::drawSettingOnOff(size_t Ycoord, Setting &sg, bool isSelected) const {
+void Game::drawSettingOnOff(size_t Ycoord, size_t index, bool isSelected) {
   static const auto OFFSET = 350;
   const auto Xcoord = m_main_win->m_width * 0.25;
-  std::string str_onoff;
+  const Setting &sg = m_settings.at(index);
+  auto &name = m_txt_setting.at(index), &onoff = m_txt_onoff.at(index);
 
-  str_onoff = (sg.active)
-                  ? (std::string("> ") + sg.txt_on + "      " + sg.txt_off)
-                  : (std::string(sg.txt_on) + "      " + "> " + sg.txt_off);
+  name.set(*m_text_renderer, Xcoord - 100, Ycoord, sg.name);
+  onoff.setf(*m_text_renderer, Xcoord + OFFSET, Ycoord, "%s%s      %s%s",
+             sg.active ? "> " : "", sg.txt_on, sg.active ? "" : "> ",
+             sg.txt_off);
 
   // draw data on the window
-  m_main_win->printOnScreen([&] {
-    m_env.setColor(isSelected ? agl::YELLOW : agl::WHITE);
-    m_text_renderer->render(Xcoord - 100, Ycoord, sg.name);
-    m_text_renderer->render(Xcoord + OFFSET, Ycoord, str_onoff);
-  });
+  m_env.setColor(isSelected ? agl::YELLOW : agl::WHITE);
+  name.draw();
+  onoff.draw();
 }
 
-void Game::drawSettingItem(size_t Xcoord, size_t Ycoord, const char *name,
-                           bool isSelected) const {
+void Game::drawSettingItem(agl::TextObject &text, size_t Xcoord,
+                           size_t Ycoord, const char *name, bool isSelected) {
   m_env.setColor(isSelected ? agl::YELLOW : agl::WHITE);
-  std::string str = isSelected ? std::string("> ") + name : name;
-  m_text_renderer->render(Xcoord, Ycoord, str);
+  text.setf(*m_text_renderer, Xcoord, Ycoord, "%s%s", isSelected ? "> " : "",
+            name);
+  text.draw();
 }
 
 // draw texture
@@ -147,20 +155,20 @@ void Game::renderMenu() {
   const static auto Ybottom = 150;
 
   // menu texture
-  m_main_win->textureWindow(m_menu_tex);
+  m_main_win->textureWindow(m_menu_tex->id());
   // print settings
-  m_main_win->printOnScreen([&] {
+  m_main_win->printOnScreen([this] {
     // title
-    m_text_big->render(Xcoord, Ycoord, "SETTINGS");
+    m_txt_title.set(*m_text_big, Xcoord, Ycoord, "SETTINGS");
+    m_txt_title.draw();
     // Settings
     for (size_t i = 0; i < N_SETTINGS; ++i) {
-      drawSettingOnOff(Ycoord - 200 - (i * OFFSET), m_settings.at(i),
-                       (m_cur_setting == i));
+      drawSettingOnOff(Ycoord - 200 - (i * OFFSET), i, (m_cur_setting == i));
     }
     // Restart & Quit
-    drawSettingItem(Xcoord - 100, Ybottom, "Restart",
+    drawSettingItem(m_txt_restart, Xcoord - 100, Ybottom, "Restart",
                     m_cur_setting == N_SETTINGS);
-    drawSettingItem(Xcoord + 500, Ybottom, "Quit",
+    drawSettingItem(m_txt_quit, Xcoord + 500, Ybottom, "Quit",
                     m_cur_setting == N_SETTINGS + 1);
   });
 
@@ -273,6 +281,9 @@ void Game::gameOver() {
           m_player_time / 1000.0);
     updateRanking();
   }
+  // shown till the game restarts
+  m_ranking = lg::readRankingData("ranking.txt");
+
   // reset handlers that must NOT be used
   m_env.set_keyup_handler();
   m_env.set_action();
@@ -320,33 +331,40 @@ void Game::drawRanking() {
   const static auto Y_O = m_main_win->m_height - 100;
   const static auto OFFSET = 170;
   const static auto INTERVAL = m_text_renderer->get_height() + 5;
-  const static auto MAX_ENTRIES = 5;
 
   // draw texture and print title
   m_main_win->colorWindow(m_victory ? agl::GREEN : agl::RED);
-  m_main_win->printOnScreen([&] {
+  m_main_win->printOnScreen([this] {
     m_env.setColor(agl::WHITE);
-    std::string title = m_victory ? "YOU WIN" : "YOU LOSE";
-    m_text_big->render(X_O, Y_O, title);
+    m_txt_title.set(*m_text_big, X_O, Y_O, m_victory ? "YOU WIN" : "YOU LOSE");
+    m_txt_title.draw();
 
     // print Ranking on screen
-    auto entries = lg::readRankingData("ranking.txt");
-    size_t todo = MAX_ENTRIES < entries.size() ? MAX_ENTRIES : entries.size();
+    size_t todo = std::min<size_t>(RANKING_ENTRIES, m_ranking.size());
+    if (todo > 0) {
+      m_txt_subtitle.set(*m_text_renderer, X_O - 100, Y_O - 100, "RANKING:");
+      m_txt_subtitle.draw();
+    }
     for (size_t i = 0; i < todo; ++i) {
-      m_text_renderer->render(X_O - 100, Y_O - 100, "RANKING:");
       // print name
-      m_text_renderer->render(X_O + 20, Y_O - OFFSET - (i * INTERVAL),
-                              entries.at(i).first);
+      m_txt_player[i].set(*m_text_renderer, X_O + 20,
+                          Y_O - OFFSET - (i * INTERVAL),
+                          m_ranking[i].first.c_str());
+      m_txt_player[i].draw();
       // print time
-      m_text_renderer->renderf(X_O + 200, Y_O - OFFSET - (i * INTERVAL),
-                               ": %2.2f", entries.at(i).second);
+      m_txt_player_time[i].setf(*m_text_renderer, X_O + 200,
+                                Y_O - OFFSET - (i * INTERVAL), ": %2.2f",
+                                m_ranking[i].second);
+      m_txt_player_time[i].draw();
     }
 
     // restart or quit
-    std::string restart = m_restart_game ? "> restart" : "restart";
-    std::string quit = m_restart_game ? "quit" : "> quit";
-    m_text_renderer->render(X_O - 100, 150, restart);
-    m_text_renderer->render(780, 150, quit);
+    m_txt_restart.set(*m_text_renderer, X_O - 100, 150,
+                      m_restart_game ? "> restart" : "restart");
+    m_txt_quit.set(*m_text_renderer, 780, 150,
+                   m_restart_game ? "quit" : "> quit");
+    m_txt_restart.draw();
+    m_txt_quit.draw();
   });
 
   // refresh window
@@ -1,10 +1,16 @@
 #ifndef _AGL_H_
 #define _AGL_H_
 
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
 #include <queue>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -72,44 +78,149 @@ struct Normal3 : public Vec3 {
   void render() const;
 };
 
-struct Vertex {
-  Point3 point;
-  Normal3 normal;
+// vertex indices are 32 bits, the same type used for GL index buffers
+using Index = GLuint;
 
-  Vertex(const Point3 &p = Point3());
+// A GL buffer object (vertex or index buffer) living in GPU memory.
+// The buffer owns its GL name: a copy starts empty and must be uploaded
+// again, so that objects holding a Buffer can still be copied around.
+// See buffer.cxx
+class Buffer {
+private:
+  GLuint m_id;
+  GLenum m_target; // GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER...
+  size_t m_size;   // bytes
+
+public:
+  Buffer(GLenum target = GL_ARRAY_BUFFER);
+  Buffer(const Buffer &other);
+  Buffer &operator=(const Buffer &other);
+  virtual ~Buffer();
+
+  // true if the GL context exposes buffer objects (GL 1.5 or the ARB ext)
+  static bool supported();
+
+  // copy data into the buffer, (re)allocating it if needed
+  void upload(const void *data, size_t size, GLenum usage = GL_STATIC_DRAW);
+  void bind() const;
+  void unbind() const;
+  // bind to an indexed target (e.g. a uniform block binding point)
+  void bindBase(GLuint index) const;
+  void release();
+
+  inline bool is_uploaded() const { return m_id != 0; }
+  inline size_t size() const { return m_size; }
+};
 
-  void render(bool send_normal = false) const;
+// vertex of the procedural geometries (torus, floor, sky...): position,
+// normal and texture coordinates, interleaved
+struct GeoVertex {
+  float pos[3];
+  float normal[3];
+  float uv[2];
+};
+
+// The view volume of the camera, as six planes. See frustum.cxx
+class Frustum {
+private:
+  float m_planes[6][4]; // a x + b y + c z + d >= 0 inside
+
+public:
+  Frustum();
+
+  // from the current projection and modelview matrices
+  void extract();
+  // false if the sphere is entirely outside
+  bool sphereInside(const Point3 &center, float radius) const;
+  // distance in front of the near plane
+  float depth(const Point3 &point) const;
+};
+
+// a range of indices of a Geometry that can be culled on its own: all of its
+// vertices are in the sphere (center, radius)
+struct GeoChunk {
+  Point3 center;
+  float radius;
+  size_t first, count;
+};
+
+// Static geometry generated once and then drawn from GL buffers with a single
+// indexed draw call. When buffer objects are not available the same arrays
+// are used as client side vertex arrays. See geometry.cxx
+class Geometry {
+private:
+  std::vector<GeoVertex> m_vertices;
+  std::vector<Index> m_indices;
+  std::vector<GeoChunk> m_chunks; // empty: drawn as a whole
+  GLenum m_mode; // primitive: GL_TRIANGLES, GL_LINES...
+  Buffer m_vbo, m_ibo;
+  float m_radius; // farthest vertex from the origin
+
+public:
+  Geometry(GLenum mode = GL_TRIANGLES);
+
+  // building: fill vertices and indices, then the next bind() uploads them
+  void clear();
+  Index addVertex(float x, float y, float z, float nx, float ny, float nz,
+                  float u = 0.0f, float v = 0.0f);
+  inline void addIndex(Index i) { m_indices.push_back(i); }
+  // the indices added after the previous chunk make a new one
+  void endChunk(const Point3 &center, float radius);
+
+  inline bool empty() const { return m_indices.empty(); }
+  inline size_t count() const { return m_indices.size(); }
+  // bounding sphere around the origin, for culling the whole geometry
+  inline float radius() const { return m_radius; }
+
+  // bind once, draw many times (e.g. with different transforms)
+  void bind(bool texcoords = false);
+  void draw();
+  void draw(size_t first, size_t count);
+  // only the chunks in the view frustum, contiguous ones with one call
+  void drawVisible();
+  void unbind();
+  // bind, drawVisible, unbind
+  void render(bool texcoords = false);
 };
 
 struct Edge {
 public:
-  Vertex *v[2]; // pointers to the 2 edge extremes 
+  Index v[2]; // indices of the 2 edge extremes
 };
 
 struct Face {
 public:
-  Vertex *verts[3]; // pointers to the 3 triangle vertices
+  Index verts[3]; // indices of the 3 triangle vertices
+};
 
-  // public cons
-  Face(Vertex *a, Vertex *b, Vertex *c);
+// number of simplified levels built on top of a full resolution Mesh
+static const size_t MESH_LOD_LEVELS = 3;
 
-  // each face has a Normal 
-  Normal3 normal; 
+// A simplified level of detail of a Mesh: it shares the vertex arrays of the
+// full resolution mesh and only has fewer faces
+struct MeshLevel {
+  std::vector<Face> faces;
+  Buffer ibo;
 
-  // computes the face normal
-  inline void computeNormal() {
-    normal = -((verts[1]->point - verts[0]->point) %
-               (verts[2]->point - verts[0]->point))
-                  .normalize();
-  }
+  MeshLevel() : ibo(GL_ELEMENT_ARRAY_BUFFER) {}
 };
 
-// A mesh object, loaded from a Wavefront Obj
+// A mesh object, loaded from a Wavefront Obj.
+// Vertex attributes are stored as separate, contiguous arrays (structure of
+// arrays) and faces refer to them by index: a Mesh can be freely copied,
+// moved and serialized, and its arrays can be sent as they are to the GPU.
 class Mesh {
 private:
-  std::vector<Vertex> m_verts; // vettore di vertici
-  std::vector<Face> m_faces;   // vettore di facce
-  //  std::vector<Edge> m_edges;   // vettore di edge (per ora, non usato)
+  std::vector<Point3> m_positions; // posizioni dei vertici
+  std::vector<Normal3> m_normals;  // normali per vertice
+  std::vector<Face> m_faces;       // vettore di facce
+  std::vector<Edge> m_edges;       // edge unici, per il wireframe
+  std::vector<MeshLevel> m_levels; // LOD chain, empty if not requested
+  std::vector<Point2> m_footprint; // built on request, see footprint()
+
+  // GPU copy of the arrays above, uploaded on the first render
+  Buffer m_vbo_positions, m_vbo_normals, m_ibo_faces, m_ibo_edges;
+
   // empty constructor. loadMesh must be used instead
   Mesh();
 
@@ -117,16 +228,50 @@ private:
   // class is loading a mesh
   void renderWire();
   void render(bool wireframe = false, bool gouraud_shading = true);
+  // draw all the triangles of a level with one indexed draw call from the
+  // GPU buffers. Level 0 is the full resolution mesh
+  void renderBuffers(size_t level);
+  void upload();
+  // setup/teardown of the vertex arrays sourced from the GPU buffers
+  void bindVertexArrays();
+  void unbindVertexArrays();
+
+  // face normals are not stored: they are only needed for flat shading
+  inline Normal3 faceNormal(const Face &face) const {
+    const auto &p0 = m_positions[face.verts[0]];
+    return -((m_positions[face.verts[1]] - p0) %
+             (m_positions[face.verts[2]] - p0))
+                .normalize();
+  }
+
+  // weld vertices, drop degenerate triangles and reorder everything for the
+  // vertex caches. See mesh_optimize.cxx
+  void optimize();
+  static void reorderFaces(std::vector<Face> &faces, size_t n_verts);
 
-  // use the 2 methods below to setup the mesh
+  // setup the mesh: vertex normals and bounding box (minumum and maximum
+  // coordinates) are computed together
   void init();
-  // bounding box: minumum and maximum coordinates
-  void computeBoundingBox();
-  void computeNormalsPerVertex();
+  void computeNormalsAndBoundingBox();
+  // fill m_edges with each edge shared by the faces, once
+  void computeEdges();
+
+  // level of detail chain, see mesh_simplify.cxx
+  void buildLevels();
+  size_t selectLevel() const;
+  inline const std::vector<Face> &levelFaces(size_t level) const {
+    return level == 0 ? m_faces : m_levels[level - 1].faces;
+  }
+
+  // binary cache of the initialized mesh (.aglmesh sidecar next to the
+  // source file). See mesh_cache.cxx
+  bool loadCache(const char *mesh_filename);
+  void saveCache(const char *mesh_filename) const;
 
 public:
   // friend function to load the mesh instead of exporting the cons
-  friend std::unique_ptr<Mesh> loadMesh(const char *mesh_filename);
+  friend std::unique_ptr<Mesh> loadMesh(const char *mesh_filename,
+                                        bool build_lod);
   Point3 bbmin, bbmax; // bounding box
 
   // frontend for the render method
@@ -136,13 +281,243 @@ public:
   // center of the axis-aligned bounding box
   // Point3 center();
   Point3 center() { return (bbmin + bbmax) / 2.0; }
+  // radius of the sphere around the mesh origin enclosing the bounding box
+  float radius() const;
+  // convex hull of the mesh seen along its Y axis (x, z), counterclockwise.
+  // Computed on the first call, then cached with the mesh
+  const std::vector<Point2> &footprint();
 };
 
-std::unique_ptr<Mesh> loadMesh(const char *mesh_filename);
+// load a mesh. If build_lod is set, the simplified levels are built as well
+// and each draw picks the one matching its size on screen
+std::unique_ptr<Mesh> loadMesh(const char *mesh_filename,
+                               bool build_lod = false);
+
+// A GL texture owned through the asset registry: the texture is deleted
+// together with its last handle
+class Texture {
+private:
+  TexID m_id;
+
+public:
+  explicit Texture(TexID id) : m_id(id) {}
+  Texture(const Texture &) = delete;
+  Texture &operator=(const Texture &) = delete;
+  virtual ~Texture();
+
+  inline TexID id() const { return m_id; }
+};
+
+using MeshHandle = std::shared_ptr<Mesh>;
+using TextureHandle = std::shared_ptr<Texture>;
+
+// Asset registry: return the already loaded asset for the same path and
+// options if anybody still holds it, load it otherwise. See assets.cxx
+MeshHandle getMesh(const char *mesh_filename, bool build_lod = false);
+TextureHandle getTexture(const char *filename, bool repeat = false,
+                         bool nearest = false);
+
+// start parsing/decoding an asset on the loader threads. The GL side is done
+// by the getMesh()/getTexture() call that asks for it, waiting only for that
+// asset if it isn't ready yet
+void prefetchMesh(const char *mesh_filename, bool build_lod = false);
+void prefetchTexture(const char *filename, bool repeat = false,
+                     bool nearest = false);
 
 using game::Key;        // custom type for game keys
 using game::MouseEvent; // custom type for mouse events
 
+// Shadow copy of the fixed-function GL state: changes that would set a value
+// already in place are filtered out before reaching the driver, and counted.
+// All drawing code changes state through Env::gl(). See gl_state.cxx
+class GLState {
+private:
+  using Params4 = std::array<float, 4>;
+  using ParamKey = std::pair<GLenum, GLenum>; // light (or face), pname
+
+  std::unordered_map<GLenum, bool> m_caps; // glEnable/glDisable
+  TexID m_texture;                         // bound on GL_TEXTURE_2D
+  GLenum m_blend_src, m_blend_dst;
+  bool m_texture_valid, m_blend_valid, m_color_valid;
+  std::unordered_map<GLenum, GLint> m_texgen; // GL_S, GL_T -> mode
+  Color m_color;
+  float m_line_width;
+  GLenum m_polygon_mode;
+  std::map<ParamKey, Params4> m_lights, m_materials;
+
+  size_t m_calls, m_skipped;
+
+  bool skip(bool unchanged);
+
+public:
+  GLState();
+
+  // the real state is unknown (e.g. new context): issue everything again
+  void invalidate();
+
+  void set(GLenum cap, bool on);
+  inline void enable(GLenum cap) { set(cap, true); }
+  inline void disable(GLenum cap) { set(cap, false); }
+
+  void bindTexture(TexID texture);
+  void deleteTexture(TexID texture);
+  void blendFunc(GLenum src, GLenum dst);
+  void texGen(GLenum coord, GLint mode);
+  void color(const Color &c);
+  // a colour array leaves the current colour undefined
+  inline void forgetColor() { m_color_valid = false; }
+  void lineWidth(float width);
+  void polygonMode(GLenum mode);
+  void lightv(GLenum light, GLenum pname, const float *params);
+  void lightf(GLenum light, GLenum pname, float param);
+  void materialv(GLenum face, GLenum pname, const float *params);
+  void materialf(GLenum face, GLenum pname, float param);
+
+  // state changes issued and filtered since the last reset
+  inline size_t calls() const { return m_calls; }
+  inline size_t skipped() const { return m_skipped; }
+  void resetCounters();
+};
+
+// Offscreen framebuffer: a square colour texture (plus depth), drawn between
+// begin() and end() and then used as any other texture. See render_target.cxx
+class RenderTarget {
+private:
+  GLuint m_fbo;
+  TexID m_texture;
+  GLuint m_depth; // renderbuffer
+  size_t m_size;
+  GLint m_viewport[4]; // restored by end()
+
+public:
+  RenderTarget();
+  RenderTarget(const RenderTarget &) = delete;
+  RenderTarget &operator=(const RenderTarget &) = delete;
+  virtual ~RenderTarget();
+
+  // true if the context has framebuffer objects (GL 3.0 or the ARB ext)
+  static bool supported();
+
+  // (re)create with size x size pixels. False (and logged) on errors
+  bool init(size_t size);
+  void begin();
+  void end();
+  void release();
+
+  inline bool ready() const { return m_fbo != 0; }
+  inline TexID texture() const { return m_texture; }
+  inline size_t size() const { return m_size; }
+};
+
+struct Material; // see RenderQueue
+
+// Positional spot light, same parameters as glLight(). Position and direction
+// in the current modelview space (eye space once given to the shaders)
+struct SpotLight {
+  float position[4];  // w = 1
+  float direction[4]; // w = 0
+  float ambient[4], diffuse[4];
+  float cutoff; // degrees
+  float exponent;
+  float constant_attenuation, linear_attenuation;
+};
+
+// Programmable pipeline for the render queue items: per pixel lighting and
+// sphere mapping in GLSL 3.30, camera and light in uniform buffers. Chosen
+// at startup, the fixed-function pipeline is the fallback. See shaders.cxx
+class ShaderPipeline {
+private:
+  GLuint m_program;
+  Buffer m_camera, m_light; // uniform buffers
+  GLint m_loc_texgen, m_loc_textured, m_loc_lighting;
+  float m_light_position[4];    // eye space
+  float m_material_specular[4]; // rgb, shininess
+  SpotLight m_spot;             // eye space
+  bool m_spot_on;
+  bool m_active; // between begin() and end()
+
+  void uploadLight();
+
+public:
+  ShaderPipeline();
+  ShaderPipeline(const ShaderPipeline &) = delete;
+  ShaderPipeline &operator=(const ShaderPipeline &) = delete;
+  virtual ~ShaderPipeline();
+
+  // true if the context can run the program (GL 3.3)
+  static bool supported();
+  // compile and link, in the current context. False (and logged) on errors
+  bool init();
+  inline bool ready() const { return m_program != 0; }
+  // delete program and buffers, before the context goes away
+  void release();
+
+  // same parameters as GL_LIGHT0 and the front material
+  void setLight(const float *eye_position);
+  void setSpecular(const float *specular, float shininess);
+  // the spot light (e.g. the headlight), nullptr to switch it off. Takes
+  // effect on the next draw, like glLight()
+  void setSpot(const SpotLight *eye_spot);
+
+  // upload camera and light, then use the program until end()
+  void begin();
+  void setMaterial(const Material &material, bool envmap);
+  void end();
+};
+
+// how buffer swaps are synced with the display
+enum class SwapMode {
+  VSYNC,    // wait for the vertical retrace
+  ADAPTIVE, // vsync, but late frames don't wait another retrace
+  UNCAPPED  // swap right away
+};
+
+// Frame pacing: swap interval, frames the CPU may queue ahead of the GPU
+// (fences, no glFinish) and an optional FPS cap. Timings of the CPU submit,
+// the GPU wait and the cap sleep are kept per frame. See frame_pacer.cxx
+class FramePacer {
+private:
+  SwapMode m_mode;
+  double m_fps_cap;    // 0: no cap
+  size_t m_max_frames; // frames in flight
+  std::deque<GLsync> m_fences;
+  std::chrono::steady_clock::time_point m_frame_start, m_next_frame;
+
+  // last frame, ms
+  double m_submit_ms, m_gpu_wait_ms, m_sleep_ms;
+  // since the last report
+  size_t m_frames;
+  double m_total_submit_ms, m_total_gpu_wait_ms, m_total_sleep_ms;
+
+public:
+  FramePacer();
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+  virtual ~FramePacer();
+
+  // true if the context has fences (GL 3.2 or ARB_sync)
+  static bool supported();
+
+  inline void set_mode(SwapMode mode) { m_mode = mode; }
+  inline void set_fps_cap(double fps) { m_fps_cap = fps; }
+  inline void set_max_frames(size_t frames) { m_max_frames = frames; }
+  // set the swap interval, once the context exists
+  void applySwapMode();
+
+  // CPU side of the frame starts
+  void beginFrame();
+  // swap, then wait for old frames and sleep as needed
+  void present(SDL_Window *window);
+
+  inline double get_submit_ms() const { return m_submit_ms; }
+  inline double get_gpu_wait_ms() const { return m_gpu_wait_ms; }
+  inline double get_sleep_ms() const { return m_sleep_ms; }
+  // log the averages since the last report
+  void report(const char *tag);
+  // delete the pending fences, before the context goes away
+  void release();
+};
+
 class SmartWindow; // pre-declared to be used in Env
 
 /* The Env class represents the Environment of the game.
@@ -157,6 +532,13 @@ private:
   double m_fps;     // fps value in the last interval
   double m_fps_now; // fps currently drawn
   uint m_last_time;
+
+  // CPU time of the render thread spent in the render handler (ms),
+  // reported every few seconds
+  double m_cpu_time;
+  size_t m_cpu_frames;
+  uint m_cpu_report_time;
+  double m_cpu_frame_ms; // average of the last report interval
   int m_screenH, m_screenW;
 
   /* Callbacks variables:
@@ -171,6 +553,33 @@ private:
   std::function<void(game::Key)> m_key_up_handler, m_key_down_handler;
   std::function<void(game::MouseEvent, int32_t, int32_t)> m_mouse_event_handler;
 
+  // cached procedural geometry
+  Geometry m_torus;
+  double m_torus_r, m_torus_R;
+  Geometry m_plane;
+  float m_plane_sz, m_plane_height;
+  size_t m_plane_quads;
+  Geometry m_sphere;
+  double m_sphere_radius;
+  int m_sphere_lats, m_sphere_longs;
+
+  GLState m_gl;
+
+  // GLSL pipeline, if requested at startup and supported
+  ShaderPipeline m_shaders;
+  bool m_use_shaders;
+
+  FramePacer m_pacer;
+
+  size_t m_shadow_map_size; // 0: shadows use the mesh footprint
+
+  // view frustum culling: the frustum is valid only in the frame it has
+  // been extracted. Objects drawn and culled are counted per frame
+  Frustum m_frustum;
+  bool m_frustum_valid;
+  size_t m_drawn, m_culled;
+  size_t m_frame_drawn, m_frame_culled; // last complete frame
+
 public:
   // expose environment vars outside the class
   bool m_wireframe, m_envmap, m_headlight, m_shadow, m_blending;
@@ -190,6 +599,20 @@ public:
   inline decltype(m_screenH) get_win_height() { return m_screenH; }
   inline decltype(m_screenW) get_win_width() { return m_screenW; }
   inline decltype(m_fps) get_fps() { return m_fps; }
+  inline decltype(m_cpu_frame_ms) get_cpu_frame_ms() { return m_cpu_frame_ms; }
+  inline GLState &gl() { return m_gl; }
+  inline ShaderPipeline &shaders() { return m_shaders; }
+  inline FramePacer &pacer() { return m_pacer; }
+  inline decltype(m_shadow_map_size) get_shadow_map_size() {
+    return m_shadow_map_size;
+  }
+  inline void set_shadow_map_size(size_t size) { m_shadow_map_size = size; }
+  inline bool isShaders() { return m_use_shaders && m_shaders.ready(); }
+  inline bool isShadersRequested() { return m_use_shaders; }
+  // before the window is created: the program is built with the context
+  inline void set_shaders(bool use_shaders) { m_use_shaders = use_shaders; }
+  inline decltype(m_frame_drawn) get_drawn() { return m_frame_drawn; }
+  inline decltype(m_frame_culled) get_culled() { return m_frame_culled; }
 
   /*
     inline decltype(m_eye_dist) eyeDist() { return m_eye_dist; }
@@ -217,26 +640,26 @@ public:
 
   std::unique_ptr<SmartWindow> createWindow(std::string &name, size_t x,
                                             size_t y, size_t w, size_t h);
+  // free the GL objects of the environment while the context still exists:
+  // the Env itself outlives the window. Geometry is rebuilt if used again
+  void releaseGL();
   void clearBuffer();
   void setColor(const Color &color);
 
   // drawing functions
-  void drawCircle(double cx, double cy, double radius);
-  void drawCubeFill(const float side);
-  void drawCubeWire(const float side);
-  void drawCube(const float side);
-  void drawFloor(TexID texbind, float sz, float height, size_t num_quads);
-  void drawPlane(float sz, float height, size_t num_quads);
+  // floor grid, built once per size and tessellation
+  Geometry &plane(float sz, float height, size_t num_quads);
   void drawPoint(double x, double y);
-  void drawSky(TexID texbind, double radius, int lats, int longs);
-  void drawSphere(double r, int lats, int longs);
-  void drawSquare(const float side);
-  void drawTorus(double r, double R);
+  // sky dome, built once per radius and tessellation
+  Geometry &sphere(double r, int lats, int longs);
+  // torus of radii r, R tessellated once and cached in a GPU buffer
+  Geometry &torus(double r, double R);
 
-  inline void disableLighting() { glDisable(GL_LIGHTING); }
-  inline void enableLighting() { glEnable(GL_LIGHTING); }
+  inline void disableLighting() { m_gl.disable(GL_LIGHTING); }
+  inline void enableLighting() { m_gl.enable(GL_LIGHTING); }
 
   void enableDoubleBuffering();
+  // swap interval of the pacer's mode, once the window is created
   void enableVSync();
   void enableZbuffer(int depth);
   void enableJoystick();
@@ -248,6 +671,9 @@ public:
   // return a texture ID --i.e. unsigned integer
   TexID loadTexture(const char *filename, bool repeat = false,
                     bool nearest = false);
+  // upload an already decoded image
+  TexID uploadTexture(SDL_Surface *surface, bool repeat = false,
+                      bool nearest = false);
 
   // Accepts a lambda to be performed between push and pop
   // Saves time and ensures the matrix will be popped after
@@ -279,8 +705,20 @@ public:
   void setupModel();
   void setupPersp();
 
+  // take the frustum from the current matrices: call it right after the
+  // camera is set, before any model transform
+  void updateFrustum();
+  // true (and counted as drawn) if a world space sphere may be on screen.
+  // Everything is visible in frames without a frustum
+  bool isVisible(const Point3 &center, float radius);
+  // distance of a world space point from the camera, along the view
+  float viewDepth(const Point3 &point) const;
+
   // Lights setup
   void setupLightPosition();
+  // enable a spot light at the current modelview, for both pipelines
+  void setSpotLight(GLenum light, const SpotLight &spot);
+  void disableSpotLight(GLenum light);
   void setupModelLights();
 
   void translate(float scale_x, float scale_y, float scale_z);
@@ -293,6 +731,86 @@ public:
 // return singleton instance
 Env &get_env();
 
+// State a draw item needs. The render queue sets it before drawing the item
+// and sorts the items by it
+struct Material {
+  TexID texture;
+  bool textured; // texture bound and enabled
+  bool texgen;   // generated texture coordinates (sphere map if envmap is on)
+  bool blend;    // alpha blending: the item goes in the transparent pass
+  bool lighting;
+  Geometry *geometry; // bound for the item (and kept bound for the next ones)
+
+  Material()
+      : texture(0), textured(false), texgen(false), blend(false),
+        lighting(true), geometry(nullptr) {}
+};
+
+// Draw items of a frame: submit them in any order, flush() draws the opaque
+// ones sorted by material, then the transparent ones back to front. A draw
+// callback sets transform and colour only: the material state is up to the
+// queue. See render_queue.cxx
+class RenderQueue {
+private:
+  struct Item {
+    Material material;
+    float depth; // view depth of the item center
+    std::function<void()> draw;
+  };
+
+  Env &m_env;
+  std::vector<Item> m_opaque, m_transparent;
+  Geometry *m_bound;
+
+  void apply(const Material &material);
+
+public:
+  RenderQueue();
+
+  // center: world space point the transparent items are sorted by
+  void submit(const Material &material, const Point3 &center,
+              std::function<void()> draw);
+  // draw everything and empty the queue
+  void flush();
+};
+
+// 2D shapes in pixel coordinates (see SmartWindow::printOnScreen), collected
+// in one vertex array and drawn together: one draw call for each run of
+// shapes with the same texture. Circles are copies of a unit disc built once.
+// See batch2d.cxx
+class Batch2D {
+private:
+  struct Vertex {
+    GLfloat x, y, u, v;
+    GLubyte rgba[4];
+  };
+
+  // consecutive vertices with the same texture (0: untextured)
+  struct Run {
+    TexID texture;
+    GLint first;
+    GLsizei count;
+  };
+
+  std::vector<Vertex> m_vertices;
+  std::vector<Run> m_runs;
+  std::vector<Point2> m_disc; // unit circle, first point repeated at the end
+  Env &m_env;
+
+  Vertex *append(TexID texture, size_t count);
+
+public:
+  Batch2D();
+
+  void circle(float cx, float cy, float radius, const Color &color);
+  void quad(float x0, float y0, float x1, float y1, const Color &color);
+  // (u, v) = (0, 0) at (x0, y0)
+  void texturedRect(TexID texture, float x0, float y0, float x1, float y1,
+                    const Color &color = Color(1, 1, 1));
+  // draw everything and empty the batch
+  void flush();
+};
+
 /*
  * SmartWindow is a class that represents a graphical window, it's basically
  * a wrapper on top of an SDL_Window.
@@ -305,6 +823,7 @@ private:
   SDL_GLContext m_GLcontext; // SDL OpenGL Context
   std::string m_name;        // window name
   Env &m_env;
+  Batch2D m_batch; // flushed at the end of printOnScreen()
 
 public:
   size_t m_width, m_height;
@@ -316,7 +835,10 @@ public:
   void refresh();
   void setupViewport();
   void show();
+  // fn draws in pixel coordinates. Shapes added to batch2d() in fn are drawn
+  // when it returns, over what fn drew directly
   void printOnScreen(std::function<void()> fn);
+  inline Batch2D &batch2d() { return m_batch; }
   void colorWindow(const Color &color);
   void textureWindow(TexID texbind);
 };
@@ -325,70 +847,168 @@ public:
  * A light and fast library to load and use TTF in OpenGL.
  * The only way to do render TTF in OpenGL is to render each glyph as a texture,
  * which of course carries a painful overhead on the game at runtime. The
- * solution is to load an atlas of chars of the selected TTF as a vector of
- * textures and store it on the GPU memory. Later on, when we'll need to render text we'll
- * just render it as a list of textured quads from pre-loaded textures.
+ * solution is to rasterize the chars of the selected TTF once and pack them in
+ * a single atlas texture, stored on the GPU memory. Later on, when we'll need
+ * to render text we'll just render a whole string as one batch of textured
+ * quads, each one with the UV rectangle of its glyph in the atlas.
+ *
+ * The atlas holds a signed distance field instead of the coverage of the
+ * glyphs: the edge is where the distance crosses 0.5, at any magnification.
+ * So a single atlas per font, rasterized at FONT_SDF_SIZE, serves every text
+ * renderer of that font whatever its size, and is cached on disk.
+ *
+ * Glyphs are rasterized lazily, the first time a code point is drawn, into
+ * pages of fixed size: a new page is added when the last one is full, and
+ * a glyph never moves once placed. Strings are UTF-8.
  */
 
-// starting offset of the ASCII chars
-static const auto ASCII_SPACE_CODE = 0x20;
-// ending offset of the ASCII chars
-static const auto ASCII_DEL_CODE = 0x7F;
+// pixel size the distance fields are computed at
+static const auto FONT_SDF_SIZE = 48;
+// distance range in pixels around the edges (and padding around the glyphs)
+static const auto FONT_SDF_SPREAD = 6;
+// side of the atlas pages, in pixels
+static const auto FONT_PAGE_SIZE = 512;
 
 // optimized X GLubyte version of a Glyph
 class Glyph {
 private:
   // members
-  char m_letter; // freetype glyph index
-  TexID m_texID;
+  uint32_t m_code; // unicode code point
+  float m_u0, m_v0, m_u1, m_v1; // UV rectangle in its page (v0: top row)
 
   GLubyte m_minx;
   GLubyte m_miny;
   GLubyte m_maxx;
   GLubyte m_maxy;
   GLubyte m_advance; // number of pixels to advance on x axis
+  GLushort m_width;  // of the bitmap in the atlas, padding included
+  GLubyte m_page;    // atlas page
 
 public:
   // accessors
   // Note: accessors use decltype as the exact type of each member
   // can be changed due to memory optimization
 
-  inline decltype(m_letter) get_letter() { return m_letter; }
-  inline decltype(m_texID) get_textureID() { return m_texID; }
-  inline decltype(m_advance) get_advance() { return m_advance; }
-  inline decltype(m_minx) get_minX() { return m_minx; }
-  inline decltype(m_miny) get_minY() { return m_miny; }
-  inline decltype(m_maxx) get_maxX() { return m_maxx; }
-  inline decltype(m_maxy) get_maxY() { return m_maxy; }
+  inline decltype(m_code) get_code() const { return m_code; }
+  inline decltype(m_advance) get_advance() const { return m_advance; }
+  inline decltype(m_minx) get_minX() const { return m_minx; }
+  inline decltype(m_miny) get_minY() const { return m_miny; }
+  inline decltype(m_maxx) get_maxX() const { return m_maxx; }
+  inline decltype(m_maxy) get_maxY() const { return m_maxy; }
+  inline decltype(m_width) get_width() const { return m_width; }
+  inline decltype(m_page) get_page() const { return m_page; }
+  inline decltype(m_u0) get_u0() const { return m_u0; }
+  inline decltype(m_v0) get_v0() const { return m_v0; }
+  inline decltype(m_u1) get_u1() const { return m_u1; }
+  inline decltype(m_v1) get_v1() const { return m_v1; }
+
+  Glyph(uint32_t code = 0, GLubyte minx = 0, GLubyte maxx = 0,
+        GLubyte miny = 0, GLubyte maxy = 0, GLubyte advance = 0);
+  // where the bitmap of the glyph ended up in the atlas
+  void place(GLubyte page, GLushort width, float u0, float v0, float u1,
+             float v1);
+};
+
+// A page of the atlas: distances (128 on the edges) and their texture.
+// Glyphs are placed in rows, left to right
+struct FontPage {
+  std::vector<GLubyte> pixels; // FONT_PAGE_SIZE x FONT_PAGE_SIZE
+  TexID texture;
+  int x, y, row_height; // next free spot
+};
+
+// Distance field atlas of a TTF, at FONT_SDF_SIZE: the glyphs met so far
+// (with their metrics) in 8 bit texture pages. Shared by all the text
+// renderers of a font through getFont(). See font_atlas.cxx
+class FontAtlas {
+private:
+  std::string m_path;
+  TTF_Font *m_font; // opened on the first glyph not in the cache
+  std::unordered_map<uint32_t, Glyph> m_glyphs;
+  std::vector<FontPage> m_pages;
+  int m_font_height; // line height at FONT_SDF_SIZE
+  bool m_dirty;      // glyphs added since the cache was written
+
+  FontAtlas(const char *font_path);
+  bool openFont();
+  // rasterize a code point, nullptr if the font hasn't got it
+  const Glyph *rasterize(uint32_t code);
+  FontPage &newPage();
+  void upload(FontPage &page);
+
+  // binary sidecar, see font_cache.cxx
+  bool loadCache();
+  void saveCache() const;
+
+public:
+  FontAtlas(const FontAtlas &) = delete;
+  FontAtlas &operator=(const FontAtlas &) = delete;
+  virtual ~FontAtlas();
+
+  // rasterized on the first request. Code points missing in the font get
+  // the glyph of '?'; nullptr only if that is missing too
+  const Glyph *glyph(uint32_t code);
+
+  inline decltype(m_font_height) get_height() const { return m_font_height; }
+  inline TexID texture(size_t page) const { return m_pages[page].texture; }
 
-  Glyph(char letter, TexID textureID, GLubyte minx, GLubyte maxx, GLubyte miny,
-        GLubyte maxy, GLubyte advance);
+  friend std::unique_ptr<FontAtlas> loadFontAtlas(const char *font_path);
+};
+
+// from the disk cache if there's one, the glyphs come on request
+std::unique_ptr<FontAtlas> loadFontAtlas(const char *font_path);
+
+using FontHandle = std::shared_ptr<FontAtlas>;
+// Asset registry for fonts, as getMesh()/getTexture(). See assets.cxx
+FontHandle getFont(const char *font_path);
+
+// consecutive vertices of a batch using the same atlas page
+struct TextRun {
+  GLuint page;
+  GLint first;
+  GLsizei count;
+};
+
+// quads of laid out text, grouped by atlas page: one draw call per page.
+// The buffers are reused, no allocations once warmed up
+struct TextBatch {
+  std::vector<GLfloat> quads; // x, y, u, v for each quad corner
+  std::vector<GLubyte> pages; // page of each quad
+  std::vector<TextRun> runs;  // set by finish()
+  std::vector<GLfloat> sorted; // scratch
+
+  void clear();
+  // group the quads by page and compute the runs
+  void finish();
+  inline size_t vertices() const { return quads.size() / 4; }
 };
 
 // Abstract GL TextRenderer
-// Responsible of loading the TTF and initialize the texture atlas vec.
+// Draws text of one size with the shared atlas of its font.
 
 class AGLTextRenderer {
 private:
-  // the texture atlas vector
-  std::vector<Glyph> m_glyphs;
-  int m_font_outline;
+  FontHandle m_atlas;
+  float m_scale; // font size / FONT_SDF_SIZE
   int m_font_height;
-  TTF_Font *m_font_ptr;
   Env &m_env; // cache envinronment
 
-  inline Glyph &get_glyph_at(size_t index) { return m_glyphs.at(index - ' '); }
-
-  void loadTextureVector();
+  // per string buffers, reused: no allocations once warmed up
+  TextBatch m_batch;
+  std::vector<char> m_format; // renderf output
 
   // prevent to call cons, use friend function instead
   AGLTextRenderer(const char *font_path, size_t font_size);
-  void renderChar(int x_o, int y_o, char letter);
+  // lay out an UTF-8 string in a batch, return the end of the string
+  int layout(int x_o, int y_o, const char *str, TextBatch &batch);
+  float layoutGlyph(float x_o, int y_o, const Glyph &glyph, TextBatch &batch);
+  // draw a batch from client memory, or from the bound buffer (base = 0)
+  void drawBatch(const TextBatch &batch, const GLfloat *base);
 
 public:
   int render(int x_o, int y_o, const char *str);
   // same as above but for std::string
-  int render(int x_o, int y_o, std::string &str);
+  int render(int x_o, int y_o, const std::string &str);
   int renderf(int x_o, int y_o, const char *fmt, ...);
   int get_width(const char *str);
 
@@ -401,6 +1021,33 @@ public:
   //                                         size_t font_size);
   friend std::unique_ptr<AGLTextRenderer> getTextRenderer(const char *font_path,
                                                           size_t font_size);
+  friend class TextObject;
+};
+
+// A retained string: laid out once and kept in a GPU buffer, drawn as it is
+// until its text (or font, or position) changes. Meant for UI text that is
+// the same for many frames: set() or setf() every frame, then draw().
+class TextObject {
+private:
+  AGLTextRenderer *m_font;
+  int m_x_o, m_y_o;
+  int m_end; // x after the last char
+  std::string m_text; // what is laid out now, capacity reused
+  TextBatch m_batch;
+  Buffer m_vbo;
+
+public:
+  TextObject();
+
+  // update the text, laying it out again only if something changed.
+  // Return true if it did
+  bool set(AGLTextRenderer &font, int x_o, int y_o, const char *text);
+  // same as above, formatted in a stack buffer (up to 255 bytes)
+  bool setf(AGLTextRenderer &font, int x_o, int y_o, const char *fmt, ...);
+  // draw with the current colour, return the end of the string
+  int draw();
+
+  inline const std::string &get_text() const { return m_text; }
 };
 
 // AGLTextRenderer *getTextRenderer(const char *font_path, size_t font_size);
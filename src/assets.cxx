@@ -0,0 +1,212 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/*
+ * Asset registry.
+ * Meshes, textures and font atlases are looked up by path and load options:
+ * as long as somebody holds a handle to an asset, asking for it again returns
+ * the same object instead of parsing/decoding the file once more. The
+ * registry itself only keeps weak references, so GPU memory is released
+ * together with the last handle.
+ *
+ * Assets can also be prefetched: OBJ parsing and image decoding run on a pool
+ * of loader threads, while the GL thread goes on (creating the window,
+ * drawing the splash screen...). Only the GL upload is left to the thread
+ * calling getMesh()/getTexture().
+ */
+
+namespace agl {
+
+namespace {
+// decoded image, freed with SDL_FreeSurface
+using Image = std::shared_ptr<SDL_Surface>;
+
+// worker threads running the CPU side of the loads, in submission order
+class Loader {
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+
+  void work() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return !m_jobs.empty(); });
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+public:
+  Loader() {
+    size_t n = std::max(2U, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < n; ++i) {
+      m_workers.emplace_back(&Loader::work, this);
+      // idle workers never hold anything: they don't need to be joined
+      m_workers.back().detach();
+    }
+  }
+
+  template <typename T> std::shared_future<T> submit(std::function<T()> fn) {
+    auto task = std::make_shared<std::packaged_task<T()>>(fn);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.emplace_back([task] { (*task)(); });
+    }
+    m_cv.notify_one();
+    return task->get_future().share();
+  }
+};
+
+// created on the first prefetch and never destroyed: detached workers may
+// still be waiting on it at exit
+Loader &get_loader() {
+  static Loader *s_loader = new Loader();
+  return *s_loader;
+}
+
+// registry and in-flight loads. Only touched by the GL thread
+std::unordered_map<std::string, std::weak_ptr<Mesh>> s_meshes;
+std::unordered_map<std::string, std::weak_ptr<Texture>> s_textures;
+std::unordered_map<std::string, std::weak_ptr<FontAtlas>> s_fonts;
+std::unordered_map<std::string, std::shared_future<MeshHandle>>
+    s_pending_meshes;
+std::unordered_map<std::string, std::shared_future<Image>> s_pending_images;
+
+std::string meshKey(const char *filename, bool build_lod) {
+  std::string key = filename;
+  if (build_lod) {
+    key += "#lod";
+  }
+  return key;
+}
+
+std::string textureKey(const char *filename, bool repeat, bool nearest) {
+  std::string key = filename;
+  if (repeat) {
+    key += "#repeat";
+  }
+  if (nearest) {
+    key += "#nearest";
+  }
+  return key;
+}
+} // namespace
+
+Texture::~Texture() {
+  // 0 is the default texture (or a failed load): nothing to delete
+  if (m_id) {
+    get_env().gl().deleteTexture(m_id);
+  }
+}
+
+void prefetchMesh(const char *filename, bool build_lod) {
+  std::string key = meshKey(filename, build_lod);
+  if (!s_meshes[key].expired() || s_pending_meshes.count(key)) {
+    return;
+  }
+
+  std::string path = filename;
+  s_pending_meshes[key] = get_loader().submit<MeshHandle>([path, build_lod] {
+    return MeshHandle(loadMesh(path.c_str(), build_lod));
+  });
+}
+
+void prefetchTexture(const char *filename, bool repeat, bool nearest) {
+  std::string key = textureKey(filename, repeat, nearest);
+  if (!s_textures[key].expired() || s_pending_images.count(key)) {
+    return;
+  }
+
+  std::string path = filename;
+  s_pending_images[key] = get_loader().submit<Image>([path] {
+    lg::i("prefetchTexture", "Decoding texture from file %s", path.c_str());
+    Image image(IMG_Load(path.c_str()), SDL_FreeSurface);
+    if (!image) {
+      lg::e("prefetchTexture", "Error while loading texture from file %s",
+            path.c_str());
+    }
+    return image;
+  });
+}
+
+MeshHandle getMesh(const char *filename, bool build_lod) {
+  static const auto TAG = __func__;
+
+  std::string key = meshKey(filename, build_lod);
+  auto &entry = s_meshes[key];
+  MeshHandle mesh = entry.lock();
+  if (mesh) {
+    lg::i(TAG, "Reusing mesh %s", filename);
+    return mesh;
+  }
+
+  auto pending = s_pending_meshes.find(key);
+  if (pending != s_pending_meshes.end()) {
+    // meshes are only uploaded on their first render: nothing left to do
+    mesh = pending->second.get();
+    s_pending_meshes.erase(pending);
+  } else {
+    mesh = MeshHandle(loadMesh(filename, build_lod));
+  }
+
+  entry = mesh;
+  return mesh;
+}
+
+TextureHandle getTexture(const char *filename, bool repeat, bool nearest) {
+  static const auto TAG = __func__;
+
+  std::string key = textureKey(filename, repeat, nearest);
+  auto &entry = s_textures[key];
+  TextureHandle texture = entry.lock();
+  if (texture) {
+    lg::i(TAG, "Reusing texture %s", filename);
+    return texture;
+  }
+
+  auto pending = s_pending_images.find(key);
+  if (pending != s_pending_images.end()) {
+    Image image = pending->second.get();
+    s_pending_images.erase(pending);
+    texture = std::make_shared<Texture>(
+        image ? get_env().uploadTexture(image.get(), repeat, nearest) : 0);
+  } else {
+    texture = std::make_shared<Texture>(
+        get_env().loadTexture(filename, repeat, nearest));
+  }
+
+  entry = texture;
+  return texture;
+}
+
+// fonts of any size share the atlas of their file
+FontHandle getFont(const char *font_path) {
+  static const auto TAG = __func__;
+
+  auto &entry = s_fonts[font_path];
+  FontHandle font = entry.lock();
+  if (font) {
+    lg::i(TAG, "Reusing font atlas %s", font_path);
+    return font;
+  }
+
+  font = FontHandle(loadFontAtlas(font_path));
+  entry = font;
+  return font;
+}
+
+} // namespace agl
@@ -0,0 +1,115 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+ * Batch2D: immediate mode 2D shapes, batched. Vertices carry position,
+ * texture coordinates and colour, so shapes of any colour go in the same
+ * draw call; only a texture change starts a new one. See agl.h
+ */
+
+namespace agl {
+
+namespace {
+// segments of the unit disc
+const size_t DISC_SEGMENTS = 24;
+
+inline GLubyte channel(float c) {
+  return GLubyte(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+} // namespace
+
+// sin/cos once for all the circles
+Batch2D::Batch2D() : m_env(get_env()) {
+  for (size_t i = 0; i <= DISC_SEGMENTS; ++i) {
+    float theta = 2.0f * M_PI * float(i % DISC_SEGMENTS) / DISC_SEGMENTS;
+    m_disc.push_back(Point2{cosf(theta), sinf(theta)});
+  }
+}
+
+// room for count vertices, on the last run if it has the same texture
+Batch2D::Vertex *Batch2D::append(TexID texture, size_t count) {
+  if (m_runs.empty() || m_runs.back().texture != texture) {
+    m_runs.push_back(Run{texture, GLint(m_vertices.size()), 0});
+  }
+  m_runs.back().count += count;
+
+  m_vertices.resize(m_vertices.size() + count);
+  return &m_vertices[m_vertices.size() - count];
+}
+
+// a triangle for each segment, fans can't be merged in one call
+void Batch2D::circle(float cx, float cy, float radius, const Color &color) {
+  Vertex center = {cx, cy, 0, 0,
+                   {channel(color.r), channel(color.g), channel(color.b),
+                    channel(color.a)}};
+  Vertex *v = append(0, 3 * DISC_SEGMENTS);
+  for (size_t i = 0; i < DISC_SEGMENTS; ++i, v += 3) {
+    v[0] = v[1] = v[2] = center;
+    v[1].x += radius * m_disc[i].x;
+    v[1].y += radius * m_disc[i].z;
+    v[2].x += radius * m_disc[i + 1].x;
+    v[2].y += radius * m_disc[i + 1].z;
+  }
+}
+
+void Batch2D::quad(float x0, float y0, float x1, float y1,
+                   const Color &color) {
+  texturedRect(0, x0, y0, x1, y1, color);
+}
+
+void Batch2D::texturedRect(TexID texture, float x0, float y0, float x1,
+                           float y1, const Color &color) {
+  GLubyte rgba[4] = {channel(color.r), channel(color.g), channel(color.b),
+                     channel(color.a)};
+  const Vertex corners[4] = {{x0, y0, 0, 0, {}},
+                             {x1, y0, 1, 0, {}},
+                             {x1, y1, 1, 1, {}},
+                             {x0, y1, 0, 1, {}}};
+
+  // two triangles
+  Vertex *v = append(texture, 6);
+  for (size_t i : {0, 1, 2, 0, 2, 3}) {
+    *v = corners[i];
+    std::copy(rgba, rgba + 4, v->rgba);
+    v++;
+  }
+}
+
+void Batch2D::flush() {
+  if (m_runs.empty()) {
+    return;
+  }
+
+  auto &gl = m_env.gl();
+  const GLsizei stride = sizeof(Vertex);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, stride, &m_vertices[0].x);
+  glTexCoordPointer(2, GL_FLOAT, stride, &m_vertices[0].u);
+  glColorPointer(4, GL_UNSIGNED_BYTE, stride, m_vertices[0].rgba);
+
+  for (const auto &run : m_runs) {
+    if (run.texture) {
+      gl.enable(GL_TEXTURE_2D);
+      gl.bindTexture(run.texture);
+    } else {
+      gl.disable(GL_TEXTURE_2D);
+    }
+    glDrawArrays(GL_TRIANGLES, run.first, run.count);
+  }
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  gl.disable(GL_TEXTURE_2D);
+  gl.forgetColor();
+
+  // keep the capacity for the next frame
+  m_vertices.clear();
+  m_runs.clear();
+}
+
+} // namespace agl
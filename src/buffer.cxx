@@ -0,0 +1,63 @@
+#include "agl.h"
+
+/*
+ * Buffer: thin RAII wrapper around a GL buffer object. See agl.h
+ */
+
+namespace agl {
+
+Buffer::Buffer(GLenum target) : m_id(0), m_target(target), m_size(0) {}
+
+// copies never share the GL name, they have to upload their own data
+Buffer::Buffer(const Buffer &other)
+    : m_id(0), m_target(other.m_target), m_size(0) {}
+
+Buffer &Buffer::operator=(const Buffer &other) {
+  if (this != &other) {
+    release();
+    m_target = other.m_target;
+  }
+  return *this;
+}
+
+Buffer::~Buffer() { release(); }
+
+bool Buffer::supported() {
+  return GLEW_VERSION_1_5 || GLEW_ARB_vertex_buffer_object;
+}
+
+void Buffer::upload(const void *data, size_t size, GLenum usage) {
+  if (!m_id) {
+    glGenBuffers(1, &m_id);
+  }
+
+  glBindBuffer(m_target, m_id);
+  if (size == m_size && size > 0) {
+    // same storage, just replace the content
+    glBufferSubData(m_target, 0, size, data);
+  } else {
+    glBufferData(m_target, size, data, usage);
+  }
+  glBindBuffer(m_target, 0);
+
+  m_size = size;
+}
+
+void Buffer::bind() const { glBindBuffer(m_target, m_id); }
+
+void Buffer::unbind() const { glBindBuffer(m_target, 0); }
+
+void Buffer::bindBase(GLuint index) const {
+  glBindBufferBase(m_target, index, m_id);
+}
+
+// free the GPU memory
+void Buffer::release() {
+  if (m_id) {
+    glDeleteBuffers(1, &m_id);
+    m_id = 0;
+    m_size = 0;
+  }
+}
+
+} // namespace agl
@@ -1,5 +1,6 @@
 
 #include "elements.h"
+#include <algorithm>
 #include <cmath>
 
 // Implementation of the objects in elements.h
@@ -9,20 +10,37 @@ namespace elements {
  * Floor
  */
 Floor::Floor(const char *texture_filename)
-    : m_size(FLOOR_SIZE), m_height(0.0f), m_env(agl::get_env()),
+    : m_size(FLOOR_SIZE), m_height(0.0f), m_quads(FLOOR_QUADS),
+      m_env(agl::get_env()),
       // repat = true, linear interpolation
-      m_tex(m_env.loadTexture(texture_filename, true, false)) {}
+      m_tex(agl::getTexture(texture_filename, true, false)) {}
 
-void Floor::render() {
+void Floor::submit(agl::RenderQueue &queue) {
   // lg::i(__func__, "Rendering floor...");
-  m_env.drawFloor(m_tex, m_size, m_height, 150);
+  // wireframe: plain colour, no lighting
+  bool wireframe = m_env.isWireframe();
+  auto &plane = m_env.plane(m_size, m_height, m_quads);
+
+  agl::Material material;
+  material.texture = m_tex->id();
+  material.textured = material.lighting = !wireframe;
+  material.geometry = &plane;
+
+  agl::Point3 center(0, m_height, 0);
+  queue.submit(material, center, [this, &plane, wireframe] {
+    m_env.setColor(wireframe ? agl::SHADOW : agl::WHITE);
+    m_env.gl().polygonMode(GL_FILL); // Whole floor
+    plane.drawVisible();
+  });
 }
 
+// file scope, to be released before the window goes
+static std::unique_ptr<Floor> s_floor(nullptr);
+
 Floor *get_floor(const char *texture_filename) {
   const static auto TAG = __func__;
   lg::i(TAG, "Loading floor texture from %s", texture_filename);
 
-  static std::unique_ptr<Floor> s_floor(nullptr);
   if (!s_floor) {
     s_floor.reset(new Floor(texture_filename)); // Init
   }
@@ -30,18 +48,35 @@ Floor *get_floor(const char *texture_filename) {
   return s_floor.get();
 }
 
+void release_floor() { s_floor.reset(); }
+
 /*
  * Sky
  */
 
 Sky::Sky(const char *texture_filename)
-    : m_radius(SKY_RADIUS), m_lats(20.0f), m_longs(20.0f),
-      m_env(agl::get_env()), m_tex(m_env.loadTexture(texture_filename, false)) {
+    : m_radius(SKY_RADIUS), m_lats(SKY_LATS), m_longs(SKY_LONGS),
+      m_env(agl::get_env()), m_tex(agl::getTexture(texture_filename, false)) {
 }
 
-void Sky::render() {
+void Sky::submit(agl::RenderQueue &queue) {
   // lg::i(__func__, "Rendering Sky...");
-  m_env.drawSky(m_tex, m_radius, m_lats, m_longs);
+  // the sky is never lit. Wireframe: black lines, no texture
+  bool wireframe = m_env.isWireframe();
+  auto &sphere = m_env.sphere(m_radius, m_lats, m_longs);
+
+  agl::Material material;
+  material.texture = m_tex->id();
+  material.textured = material.texgen = !wireframe;
+  material.lighting = false;
+  material.geometry = &sphere;
+
+  queue.submit(material, agl::Point3(), [this, &sphere, wireframe] {
+    m_env.setColor(wireframe ? agl::BLACK : agl::WHITE);
+    m_env.gl().polygonMode(wireframe ? GL_LINE : GL_FILL);
+    sphere.drawVisible();
+    m_env.gl().polygonMode(GL_FILL);
+  });
 }
 
 void Sky::set_params(double radius, int lats, int longs) {
@@ -50,11 +85,13 @@ void Sky::set_params(double radius, int lats, int longs) {
   m_longs = longs;
 }
 
+// file scope, to be released before the window goes
+static std::unique_ptr<Sky> s_sky(nullptr);
+
 Sky *get_sky(const char *texture_filename) {
   const static auto TAG = __func__;
   lg::i(TAG, "Loading Sky texture from %s", texture_filename);
 
-  static std::unique_ptr<Sky> s_sky(nullptr);
   if (!s_sky) {
     s_sky.reset(new Sky(texture_filename)); // Init
   }
@@ -62,6 +99,8 @@ Sky *get_sky(const char *texture_filename) {
   return s_sky.get();
 }
 
+void release_sky() { s_sky.reset(); }
+
 /*
  * Ring. See elements::Ring
  *
@@ -86,25 +125,27 @@ const agl::Vec3 Ring::s_viewUP = agl::Vec3(0.0, 1.0, 0.0);
 const float Ring::s_r = 0.3; // inner radius
 const float Ring::s_R = 2.5; // outer radius
 
-void Ring::render() {
-  m_env.mat_scope([&] {
-    m_env.translate(m_px, m_py, m_pz);
-    m_env.rotate(m_angle, s_viewUP);
-    // set the proper color if triggered
-    m_env.setColor(m_triggered ? TRIGGERED : NOT_TRIGGERED);
-
-    if (m_env.isBlending()) {
-      // maybe move this to Env helper function
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-      m_env.drawTorus(s_r, s_R);
-
-      glDisable(GL_BLEND);
-    } else {
-      m_env.drawTorus(s_r, s_R);
-    }
-
+void Ring::submit(agl::RenderQueue &queue) {
+  // all the rings share the cached torus: the queue binds it once for
+  // consecutive rings. It is drawn at twice the radii: cull it with the
+  // radius of the actual geometry
+  auto &torus = m_env.torus(s_r, s_R);
+  agl::Point3 center(m_px, m_py, m_pz);
+  if (!m_env.isVisible(center, torus.radius())) {
+    return;
+  }
+  agl::Material material;
+  material.blend = m_env.isBlending();
+  material.geometry = &torus;
+
+  queue.submit(material, center, [this, &torus] {
+    m_env.mat_scope([&] {
+      m_env.translate(m_px, m_py, m_pz);
+      m_env.rotate(m_angle, s_viewUP);
+      // set the proper color if triggered
+      m_env.setColor(m_triggered ? TRIGGERED : NOT_TRIGGERED);
+      torus.draw();
+    });
   });
 }
 
@@ -187,30 +228,116 @@ BadCube::BadCube(float x, float y, float z, bool flight_mode, float angle)
 }
 
 // initaliazing static members of BadCube class
-// view UP vector
-const agl::Vec3 BadCube::s_viewUP = agl::Vec3(0.0, 1.0, 0.0);
 const float BadCube::side = 2.5; // side of the cube
 
-void BadCube::render() {
-  m_env.mat_scope([&] {
-    m_env.translate(m_px, m_py, m_pz);
-    m_env.rotate(m_angle, s_viewUP);
-    
-    // if blending is not active the cubes will be just plain squares
-    if (m_env.isBlending()) {
-      // maybe move this to Env helper function
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-      m_env.drawCube(side);
-
-      glDisable(GL_BLEND);
-    } else {
-      m_env.setColor(agl::YELLOW);
-      m_env.drawSquare(side);
+namespace {
+// cube with corners in (+-1, +-1, +-1): the normal and the 4 corners of
+// each of the 6 faces, and the 12 edges, the first 4 making the square of
+// the face z = +1
+const float CUBE_NORMALS[6][3] = {{0, 0, +1}, {0, 0, -1}, {0, +1, 0},
+                                  {0, -1, 0}, {+1, 0, 0}, {-1, 0, 0}};
+const float CUBE_FACES[6][4][3] = {
+    {{+1, +1, +1}, {-1, +1, +1}, {-1, -1, +1}, {+1, -1, +1}},
+    {{+1, -1, -1}, {-1, -1, -1}, {-1, +1, -1}, {+1, +1, -1}},
+    {{+1, +1, +1}, {-1, +1, +1}, {-1, +1, -1}, {+1, +1, -1}},
+    {{+1, -1, -1}, {-1, -1, -1}, {-1, -1, +1}, {+1, -1, +1}},
+    {{+1, +1, +1}, {+1, -1, +1}, {+1, -1, -1}, {+1, +1, -1}},
+    {{-1, +1, -1}, {-1, -1, -1}, {-1, -1, +1}, {-1, +1, +1}}};
+const float CUBE_EDGES[12][2][3] = {
+    // face z=+side (also the square drawn without blending)
+    {{+1, +1, +1}, {-1, +1, +1}},
+    {{-1, +1, +1}, {-1, -1, +1}},
+    {{-1, -1, +1}, {+1, -1, +1}},
+    {{+1, -1, +1}, {+1, +1, +1}},
+    // face z=-side
+    {{+1, -1, -1}, {-1, -1, -1}},
+    {{-1, -1, -1}, {-1, +1, -1}},
+    {{-1, +1, -1}, {+1, +1, -1}},
+    {{+1, +1, -1}, {+1, -1, -1}},
+    // 4 segments from -z to +z
+    {{-1, -1, -1}, {-1, -1, +1}},
+    {{+1, -1, -1}, {+1, -1, +1}},
+    {{+1, +1, -1}, {+1, +1, +1}},
+    {{-1, +1, -1}, {-1, +1, +1}}};
+const size_t SQUARE_EDGES = 4;
+} // namespace
+
+CubeBatch::CubeBatch()
+    : m_fills(GL_TRIANGLES), m_wires(GL_LINES), m_squares(GL_LINES),
+      m_env(agl::get_env()) {}
+
+void CubeBatch::build(const std::vector<BadCube> &cubes) {
+  m_fills.clear();
+  m_wires.clear();
+  m_squares.clear();
+
+  const float S = BadCube::side;
+  for (const auto &cube : cubes) {
+    // scaled by side, rotated by m_angle around Y, moved to (px, py, pz)
+    float cos_a = cosf(cube.m_angle * M_PI / 180.0f);
+    float sin_a = sinf(cube.m_angle * M_PI / 180.0f);
+    auto vertex = [&](agl::Geometry &geo, const float *p, const float *n) {
+      return geo.addVertex(
+          cube.m_px + S * (p[0] * cos_a + p[2] * sin_a), cube.m_py + S * p[1],
+          cube.m_pz + S * (-p[0] * sin_a + p[2] * cos_a),
+          n[0] * cos_a + n[2] * sin_a, n[1], -n[0] * sin_a + n[2] * cos_a);
+    };
+
+    for (size_t f = 0; f < 6; ++f) {
+      agl::Index first = vertex(m_fills, CUBE_FACES[f][0], CUBE_NORMALS[f]);
+      for (size_t k = 1; k < 4; ++k) {
+        vertex(m_fills, CUBE_FACES[f][k], CUBE_NORMALS[f]);
+      }
+      // quad split in two triangles
+      for (agl::Index k : {0, 1, 2, 0, 2, 3}) {
+        m_fills.addIndex(first + k);
+      }
     }
 
-  });
+    static const float NO_NORMAL[3] = {0, 0, 1};
+    for (size_t e = 0; e < 12; ++e) {
+      for (size_t k = 0; k < 2; ++k) {
+        m_wires.addIndex(vertex(m_wires, CUBE_EDGES[e][k], NO_NORMAL));
+        if (e < SQUARE_EDGES) {
+          m_squares.addIndex(vertex(m_squares, CUBE_EDGES[e][k], NO_NORMAL));
+        }
+      }
+    }
+
+    // each cube can be culled on its own
+    agl::Point3 center(cube.m_px, cube.m_py, cube.m_pz);
+    float radius = S * std::sqrt(3.0f);
+    m_fills.endChunk(center, radius);
+    m_wires.endChunk(center, radius);
+    m_squares.endChunk(center, radius);
+  }
+}
+
+void CubeBatch::submit(agl::RenderQueue &queue) {
+  if (m_fills.empty()) {
+    return;
+  }
+
+  // cube colours have alpha 1: blended or not they look the same, so the
+  // batch goes with the opaque items either way
+  agl::Material material;
+
+  // if blending is not active the cubes will be just plain squares
+  if (m_env.isBlending()) {
+    queue.submit(material, agl::Point3(), [this] {
+      m_env.setColor(agl::LIGHT_YELLOW);
+      m_fills.render();
+      m_env.setColor(agl::BLACK);
+      m_env.lineWidth(12.0);
+      m_wires.render();
+    });
+  } else {
+    queue.submit(material, agl::Point3(), [this] {
+      m_env.setColor(agl::YELLOW);
+      m_env.lineWidth(10.0);
+      m_squares.render();
+    });
+  }
 }
 
 bool BadCube::checkCrossing(float x, float z) {
@@ -281,26 +408,38 @@ Door::Door(const char *mesh_filename, const char *texture_filename)
     : m_px(0), m_py(6.0), m_pz(-(FLOOR_SIZE - 1.0)), m_scaleX(DOOR_SCALE),
       m_scaleY(DOOR_SCALE), m_scaleZ(DOOR_SCALE), m_angle(30),
       m_ship_old_z(INFINITY), m_env(agl::get_env()),
-      m_mesh(agl::loadMesh(mesh_filename)), m_tex(m_env.loadTexture(texture_filename)) {}
+      m_mesh(agl::getMesh(mesh_filename, true)), m_tex(agl::getTexture(texture_filename)) {}
 
 // initaliazing static members of Door class
 // view UP vector
 const agl::Vec3 Door::s_viewUP = agl::Vec3(0.0, 1.0, 0.0);
 const float Door::side = 2.5; // door side
 
-void Door::render() {
-    m_env.textureDrawing(m_tex, [&] {
-  m_env.mat_scope([&] {
-    m_env.translate(m_px, m_py, m_pz);
-    // adjust mesh pre-defined angle
-    m_env.rotate(m_angle, s_viewUP);
-    m_env.rotate(90, agl::Vec3(1.0, 0.0, 0.0));
-    m_env.rotate(45, agl::Vec3(0, 0, 1));
-    // scale mesh
-    m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
-    m_mesh->renderGouraud(m_env.isWireframe());
-  });
+void Door::submit(agl::RenderQueue &queue) {
+  agl::Point3 center(m_px, m_py, m_pz);
+  float scale = std::max(m_scaleX, std::max(m_scaleY, m_scaleZ));
+  if (!m_env.isVisible(center, scale * m_mesh->radius())) {
+    return;
+  }
+
+  // textured with generated coordinates, plain in wireframe
+  agl::Material material;
+  material.texture = m_tex->id();
+  material.textured = material.texgen = !m_env.isWireframe();
+
+  queue.submit(material, center, [this] {
+    m_env.setColor(agl::WHITE);
+    m_env.mat_scope([&] {
+      m_env.translate(m_px, m_py, m_pz);
+      // adjust mesh pre-defined angle
+      m_env.rotate(m_angle, s_viewUP);
+      m_env.rotate(90, agl::Vec3(1.0, 0.0, 0.0));
+      m_env.rotate(45, agl::Vec3(0, 0, 1));
+      // scale mesh
+      m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
+      m_mesh->renderGouraud(m_env.isWireframe());
     });
+  });
 }
 
 bool Door::checkCrossing(float x, float z) {
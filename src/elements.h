@@ -29,8 +29,9 @@ const std::string motion_to_str(spaceship::Motion mt);
 class Floor {
 private:
   float m_size, m_height;
-  agl::Env &m_env;  // reference to env, needed in the constructor
-  agl::TexID m_tex; // floor texture
+  size_t m_quads; // tessellation: quads per side
+  agl::Env &m_env;          // reference to env, needed in the constructor
+  agl::TextureHandle m_tex; // floor texture
 
   // construct the floor loading the texture
   Floor(const char *texture_filename);
@@ -39,17 +40,22 @@ public:
   // friend function to load the texture and create a singleton
   friend Floor *get_floor(const char *filename);
 
-  void render();
+  void submit(agl::RenderQueue &queue);
+
+  // the grid is rebuilt on the next render
+  inline void set_tessellation(size_t quads) { m_quads = quads; }
 };
 
 // get singleton instance of floor
 Floor *get_floor(const char *filename);
+// destroy it, with its texture, while the GL context is still there
+void release_floor();
 
 // The Sky. Same mechanism as above
 class Sky {
 private:
   agl::Env &m_env;
-  agl::TexID m_tex;
+  agl::TextureHandle m_tex;
   double m_radius;
   int m_lats, m_longs;
 
@@ -60,16 +66,20 @@ public:
   // friend function to load the texture and create a singleton
   friend Sky *get_sky(const char *filename);
 
-  void render();
+  void submit(agl::RenderQueue &queue);
 
   // accessors
-  void set_params(double radius = 100.0, int lats = 20, int longs = 20);
+  // the sky dome is rebuilt on the next render only if these change
+  void set_params(double radius = 100.0, int lats = SKY_LATS,
+                  int longs = SKY_LONGS);
 
   inline decltype(m_radius) radius() { return m_radius; }
 };
 
 // get singleton instance of sky
 Sky *get_sky(const char *filename);
+// destroy it, with its texture, while the GL context is still there
+void release_sky();
 
 /*
  * RING class.
@@ -105,7 +115,8 @@ public:
 
   Ring(float x, float y, float z, bool m_3D_FLIGHT = false, float angle = 30.0);
 
-  void render();
+  // blended (transparent) if blending is on
+  void submit(agl::RenderQueue &queue);
 
   // check if the new ship position has crossed the ring
   void checkCrossing(float x, float z);
@@ -113,10 +124,10 @@ public:
   void checkCrossing(float x, float y, float z);
 
   // accessors
-  inline float x() { return m_px; }
-  inline float y() { return m_py; }
-  inline float z() { return m_pz; }
-  inline bool isTriggered() { return m_triggered; }
+  inline float x() const { return m_px; }
+  inline float y() const { return m_py; }
+  inline float z() const { return m_pz; }
+  inline bool isTriggered() const { return m_triggered; }
 };
 
 /*
@@ -139,27 +150,44 @@ private:
 
   agl::Env &m_env; // env reference
 
+  friend class CubeBatch;
+
 public:
   // static members
-  // view UP vector
-  static const agl::Vec3 s_viewUP;
   // radius values
   static const float side;
 
   BadCube(float x, float y, float z, bool m_3D_FLIGHT = false,
           float angle = 30.0);
 
-  void render();
-
   // check if the new ship position has crossed the ring
   bool checkCrossing(float x, float z);
   // same but for flight mode
   bool checkCrossing(float x, float y, float z);
 
   // accessors
-  inline float x() { return m_px; }
-  inline float y() { return m_py; }
-  inline float z() { return m_pz; }
+  inline float x() const { return m_px; }
+  inline float y() const { return m_py; }
+  inline float z() const { return m_pz; }
+};
+
+/*
+ * All the BadCubes drawn together.
+ * Cubes never move: their fills, edges and squares (the no-blending look) are
+ * built once, already in world space, in three static buffers. A frame is
+ * then one draw call for each of them, whatever the number of cubes.
+ */
+class CubeBatch {
+private:
+  agl::Geometry m_fills, m_wires, m_squares;
+  agl::Env &m_env;
+
+public:
+  CubeBatch();
+
+  // (re)build the buffers, whenever the cubes change
+  void build(const std::vector<BadCube> &cubes);
+  void submit(agl::RenderQueue &queue);
 };
 
 /*
@@ -171,8 +199,8 @@ public:
 class Door {
 
 private:
-  std::unique_ptr<agl::Mesh> m_mesh;
-  agl::TexID m_tex;
+  agl::MeshHandle m_mesh;
+  agl::TextureHandle m_tex;
   float m_px, m_py, m_pz;             // coords
   float m_scaleX, m_scaleY, m_scaleZ; // scaling factors
   float m_ship_old_z; // the previous ship position wrt ring ref frame
@@ -193,15 +221,15 @@ public:
   // radius values to check crossing
   static const float side;
 
-  void render();
+  void submit(agl::RenderQueue &queue);
 
   // check if the new ship position has crossed the ring
   bool checkCrossing(float x, float z);
 
   // accessors
-  inline float x() { return m_px; }
-  inline float y() { return m_py; }
-  inline float z() { return m_pz; }
+  inline float x() const { return m_px; }
+  inline float y() const { return m_py; }
+  inline float z() const { return m_pz; }
 };
 
 std::unique_ptr<Door> get_door(const char *mesh_filename,
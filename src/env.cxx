@@ -1,8 +1,34 @@
 #include "agl.h"
 #include <SDL2/SDL_ttf.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace agl {
 
+namespace {
+// CPU time of the calling thread, in ms: loader and driver threads don't
+// count, unlike std::clock()
+double threadCpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// v times the current modelview, as GL does with the light positions and
+// directions (w = 0)
+void toEyeSpace(const float *v, float *eye) {
+  float model[16];
+  glGetFloatv(GL_MODELVIEW_MATRIX, model);
+  for (size_t r = 0; r < 4; ++r) {
+    eye[r] = 0.0f;
+    for (size_t c = 0; c < 4; ++c) {
+      eye[r] += model[c * 4 + r] * v[c];
+    }
+  }
+}
+} // namespace
+
 // Returns the singleton instance of agl::Env, initializing it if necessary
 Env &get_env() {
   // having a unique ptr ensures the Env will be called only during the main
@@ -16,13 +42,21 @@ Env &get_env() {
 
 // constructs the environment, initializing stuff
 Env::Env()
-    // All callbacks are init to empty lambdas
-    : m_action_handler([] {}), m_render_handler([] {}),
-      m_window_event_handler([] {}), m_key_down_handler([](Key) {}),
-      m_key_up_handler([](Key) {}),
-
-      // all environment variables
-      m_screenH(750), m_screenW(900), m_wireframe(false), m_envmap(true),
+    // all environment variables
+    : m_cpu_time(0.0), m_cpu_frames(0), m_cpu_report_time(0),
+      m_cpu_frame_ms(0.0), m_screenH(750), m_screenW(900),
+
+      // All callbacks are init to empty lambdas
+      m_action_handler([] {}), m_render_handler([] {}),
+      m_window_event_handler([] {}), m_key_up_handler([](Key) {}),
+      m_key_down_handler([](Key) {}),
+
+      m_torus(GL_TRIANGLES), m_torus_r(0.0), m_torus_R(0.0),
+      m_plane(GL_TRIANGLES), m_plane_sz(0.0f), m_plane_height(0.0f),
+      m_plane_quads(0), m_sphere(GL_TRIANGLES), m_sphere_radius(0.0),
+      m_sphere_lats(0), m_sphere_longs(0), m_use_shaders(false),
+      m_shadow_map_size(0), m_frustum_valid(false), m_drawn(0), m_culled(0),
+      m_frame_drawn(0), m_frame_culled(0), m_wireframe(false), m_envmap(true),
       m_headlight(false), m_shadow(false), m_blending(true) {
 
   // -----> "__func__" == function name
@@ -104,20 +138,10 @@ void Env::enableDoubleBuffering() {
 // This prevents the video card from changing the display memory until the
 // monitor is done with its current refresh cycle. When applied, the rendering
 // engine would match the maximum refresh rate of the monitor *if* the frame
-// rate being produced by the application is higher. First tries to enable
-// advanced adaptive vsync; if fails, fallbacks on the normal one.
-
-void Env::enableVSync() {
-  static const auto TAG = __func__;
-
-  lg::i(TAG, "Try to enable adactive VSync...");
-  if (SDL_GL_SetSwapInterval(-1) < 0) {
-    lg::i(TAG, "Adaptive VSync not available. Trying for normal vsync...");
-    if (SDL_GL_SetSwapInterval(1) < 0) {
-      lg::i(TAG, "VSync not available!");
-    }
-  }
-}
+// rate being produced by the application is higher. The mode (adaptive,
+// normal or no vsync) is the one set in the frame pacer, adaptive falls back
+// on the normal one.
+void Env::enableVSync() { m_pacer.applySwapMode(); }
 
 /* enables joystick
 // NOT used in this application
@@ -140,9 +164,7 @@ void Env::mat_scope(const std::function<void(void)> callback) {
 
 Uint32 Env::getTicks() { return SDL_GetTicks(); }
 
-void setColor(const Color &color) {
-  glColor4f(color.r, color.g, color.b, color.a);
-}
+void setColor(const Color &color) { get_env().gl().color(color); }
 
 void Env::clearBuffer() {
   // background colore = WHITE 
@@ -156,174 +178,73 @@ std::unique_ptr<SmartWindow> Env::createWindow(std::string &name, size_t x,
   return std::unique_ptr<SmartWindow>(new SmartWindow(name, x, y, w, h));
 }
 
-// draw a circle
-void Env::drawCircle(double cx, double cy, double radius) {
-  const static auto N_SEGMENTS = 25;
-
-  glBegin(GL_TRIANGLE_FAN);
-  for (int i = 0; i < N_SEGMENTS; ++i) {
-    float theta = 2.0f * M_PI * float(i) / float(N_SEGMENTS); // current angle
-
-    float x = radius * cosf(theta); // calculate the x component
-    float y = radius * sinf(theta); // calculate the y component
-
-    glVertex2f(x + cx, y + cy); // output vertex
+// called by the window before deleting its context
+void Env::releaseGL() {
+  static const auto TAG = __func__;
+  lg::i(TAG, "releasing GL resources");
+
+  m_torus.clear();
+  m_plane.clear();
+  m_sphere.clear();
+  m_shaders.release();
+  m_pacer.release();
+}
+
+// Grid of num_quads^2 quads on the plane y = height, from -sz to +sz, built
+// once. Vertices are shared by the adjacent quads: texture coordinates are
+// the grid coordinates, that with GL_REPEAT map the texture once per quad as
+// before
+Geometry &Env::plane(float sz, float height, size_t num_quads) {
+  if (!m_plane.empty() && m_plane_sz == sz && m_plane_height == height &&
+      m_plane_quads == num_quads) {
+    return m_plane;
   }
-  glEnd();
-}
-
-// draw a cube rasterizing quads
-void Env::drawCubeFill(const float S) {
-
-  glBegin(GL_QUADS);
-
-  glNormal3f(0, 0, +1);
-  glVertex3f(+S, +S, +S);
-  glVertex3f(-S, +S, +S);
-  glVertex3f(-S, -S, +S);
-  glVertex3f(+S, -S, +S);
-
-  glNormal3f(0, 0, -1);
-  glVertex3f(+S, -S, -S);
-  glVertex3f(-S, -S, -S);
-  glVertex3f(-S, +S, -S);
-  glVertex3f(+S, +S, -S);
 
-  glNormal3f(0, +1, 0);
-  glVertex3f(+S, +S, +S);
-  glVertex3f(-S, +S, +S);
-  glVertex3f(-S, +S, -S);
-  glVertex3f(+S, +S, -S);
+  m_plane.clear();
+  m_plane_sz = sz;
+  m_plane_height = height;
+  m_plane_quads = num_quads;
 
-  glNormal3f(0, -1, 0);
-  glVertex3f(+S, -S, -S);
-  glVertex3f(-S, -S, -S);
-  glVertex3f(-S, -S, +S);
-  glVertex3f(+S, -S, +S);
-
-  glNormal3f(+1, 0, 0);
-  glVertex3f(+S, +S, +S);
-  glVertex3f(+S, -S, +S);
-  glVertex3f(+S, -S, -S);
-  glVertex3f(+S, +S, -S);
-
-  glNormal3f(-1, 0, 0);
-  glVertex3f(-S, +S, -S);
-  glVertex3f(-S, -S, -S);
-  glVertex3f(-S, -S, +S);
-  glVertex3f(-S, +S, +S);
-
-  glEnd();
-}
-
-// draw a wireframe cube
-void Env::drawCubeWire(const float side) {
-  lineWidth(12.0);
-
-  glBegin(GL_LINE_LOOP); // face z=+side
-  glVertex3f(+side, +side, +side);
-  glVertex3f(-side, +side, +side);
-  glVertex3f(-side, -side, +side);
-  glVertex3f(+side, -side, +side);
-  glEnd();
-
-  glBegin(GL_LINE_LOOP); // face z=-side
-  glVertex3f(+side, -side, -side);
-  glVertex3f(-side, -side, -side);
-  glVertex3f(-side, +side, -side);
-  glVertex3f(+side, +side, -side);
-  glEnd();
-
-  glBegin(GL_LINES); // 4 segments from -z to +z
-  glVertex3f(-side, -side, -side);
-  glVertex3f(-side, -side, +side);
-
-  glVertex3f(+side, -side, -side);
-  glVertex3f(+side, -side, +side);
-
-  glVertex3f(+side, +side, -side);
-  glVertex3f(+side, +side, +side);
-
-  glVertex3f(-side, +side, -side);
-  glVertex3f(-side, +side, +side);
-  glEnd();
-}
-
-void Env::drawCube(const float side) {
-  setColor(LIGHT_YELLOW);
-  drawCubeFill(side);
-  setColor(BLACK);
-  drawCubeWire(side);
-}
-
-// size 'sz' should be ~100.0f
-void Env::drawPlane(float sz, float height, size_t num_quads) {
-  glNormal3f(0, 1, 0); // normale verticale uguale x tutti
   auto ratio = (double)sz / num_quads;
-  glBegin(GL_QUADS);
-  {
-    for (size_t x = 0; x < num_quads; ++x) {
-      for (size_t z = 0; z < num_quads; ++z) {
-        float x0 = -sz + 2 * (x + 0) * ratio;
-        float x1 = -sz + 2 * (x + 1) * ratio;
-        float z0 = -sz + 2 * (z + 0) * ratio;
-        float z1 = -sz + 2 * (z + 1) * ratio;
-
-        if (!m_wireframe) {
-          // bottom left
-          glTexCoord2f(0.0f, 1.0f);
-          glVertex3d(x0, height, z1);
-
-          // top left
-          glTexCoord2f(0.0f, 0.0f);
-          glVertex3d(x0, height, z0);
-
-          // top right
-          glTexCoord2f(1.0f, 0.0f);
-          glVertex3d(x1, height, z0);
-
-          // bottom right
-          glTexCoord2f(1.0f, 1.0f);
-          glVertex3d(x1, height, z1);
-        } else {
-          glVertex3d(x0, height, z1);
-          glVertex3d(x0, height, z0);
-          glVertex3d(x1, height, z0);
-          glVertex3d(x1, height, z1);
-        }
-      }
+  for (size_t x = 0; x <= num_quads; ++x) {
+    for (size_t z = 0; z <= num_quads; ++z) {
+      // normale verticale uguale x tutti
+      m_plane.addVertex(-sz + 2 * x * ratio, height, -sz + 2 * z * ratio, 0, 1,
+                        0, x, z);
     }
   }
-  glEnd();
-}
 
-void Env::drawFloor(TexID texbind, float sz, float height, size_t num_quads) {
-
-  textureDrawing(texbind,
-                 [&] {
-                   // draw num_quads^2 number of quads
-
-                   if (m_wireframe) {
-                     glDisable(GL_TEXTURE_2D);
-                     glColor3f(SHADOW.r, SHADOW.g, SHADOW.b);
-
-                     glDisable(GL_LIGHTING);
-                     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // LINES
-                     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // Whole floor
-                     drawPlane(sz, height, num_quads);
+  auto index = [num_quads](size_t x, size_t z) {
+    return Index(x * (num_quads + 1) + z);
+  };
+  // quads are grouped in square tiles, culled one by one against the view
+  for (size_t x0 = 0; x0 < num_quads; x0 += PLANE_TILE_QUADS) {
+    for (size_t z0 = 0; z0 < num_quads; z0 += PLANE_TILE_QUADS) {
+      size_t x1 = std::min(x0 + PLANE_TILE_QUADS, num_quads);
+      size_t z1 = std::min(z0 + PLANE_TILE_QUADS, num_quads);
+      for (size_t x = x0; x < x1; ++x) {
+        for (size_t z = z0; z < z1; ++z) {
+          // bottom left, top left, top right / bottom left, top right, bottom
+          // right: the old quad, split in two
+          m_plane.addIndex(index(x, z + 1));
+          m_plane.addIndex(index(x, z));
+          m_plane.addIndex(index(x + 1, z));
+
+          m_plane.addIndex(index(x, z + 1));
+          m_plane.addIndex(index(x + 1, z));
+          m_plane.addIndex(index(x + 1, z + 1));
+        }
+      }
 
-                     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-                     glColor3f(WHITE.r, WHITE.g, WHITE.b);
-                     glEnable(GL_LIGHTING);
-                   } else {
-                     // glColor3f(0.6, 0.6, 0.6); // colore uguale x tutti i
-                     // quads
-                     glNormal3f(0, 1, 0); // normale verticale uguale x tutti
-                     drawPlane(sz, height, num_quads);
-                   }
+      // flat tile: the sphere is the one through its corners
+      float half_x = (x1 - x0) * ratio, half_z = (z1 - z0) * ratio;
+      m_plane.endChunk(Point3(-sz + (x0 + x1) * ratio, height,
+                              -sz + (z0 + z1) * ratio),
+                       std::sqrt(half_x * half_x + half_z * half_z));
+    }
+  }
 
-                 },
-                 false);
+  return m_plane;
 }
 
 void Env::drawPoint(double x, double y) {
@@ -334,121 +255,112 @@ void Env::drawPoint(double x, double y) {
   glFlush();
 }
 
-// hint: should be TexID, 100.0, 20.0, 20.0 --> see Sky constructor
-void Env::drawSky(TexID texbind, double radius, int lats, int longs) {
-
-  textureDrawing(texbind,
-                 [&] {
-
-                   if (m_wireframe) {
-                     glDisable(GL_TEXTURE_2D);
-                     glColor3f(BLACK.r, BLACK.g, BLACK.b);
-                     glDisable(GL_LIGHTING);
-                     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-                     drawSphere(radius, lats, longs);
-
-                     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-                     glColor3f(WHITE.r, WHITE.g, WHITE.b);
-                     glEnable(GL_LIGHTING);
-                   } else {
-                     glColor3f(WHITE.r, WHITE.g, WHITE.b);
-                     glDisable(GL_LIGHTING);
-
-                     drawSphere(radius, lats, longs);
-
-                     glEnable(GL_LIGHTING);
-                   }
-
-                 },
-                 true);
-}
+// Sphere tessellated once per (radius, lats, longs).
+// Same rows and columns as the old quad strips: one row of vertices per
+// latitude, from one step below the south pole up to the north pole, and
+// one strip of two triangles per quad between consecutive rows
+Geometry &Env::sphere(double radius, int lats, int longs) {
+  if (!m_sphere.empty() && m_sphere_radius == radius &&
+      m_sphere_lats == lats && m_sphere_longs == longs) {
+    return m_sphere;
+  }
 
-void Env::drawSphere(double radius, int lats, int longs) {
-  int i, j;
-  for (i = 0; i <= lats; i++) {
-    double lat0 = M_PI * (-0.5 + (double)(i - 1) / lats);
-    double z0 = sin(lat0);
-    double zr0 = cos(lat0);
+  m_sphere.clear();
+  m_sphere_radius = radius;
+  m_sphere_lats = lats;
+  m_sphere_longs = longs;
 
-    double lat1 = M_PI * (-0.5 + (double)i / lats);
-    double z1 = sin(lat1);
-    double zr1 = cos(lat1);
+  for (int i = -1; i <= lats; i++) {
+    double lat = M_PI * (-0.5 + (double)i / lats);
+    double z = sin(lat);
+    double zr = cos(lat);
 
-    glBegin(GL_QUAD_STRIP);
-    for (j = 0; j <= longs; j++) {
+    for (int j = 0; j <= longs; j++) {
       double lng = 2 * M_PI * (double)(j - 1) / longs;
       double x = cos(lng);
       double y = sin(lng);
 
       // Normal are needed for the EnvMap
-      glNormal3f(x * zr0, y * zr0, z0);
-      glVertex3f(radius * x * zr0, radius * y * zr0, radius * z0);
-      glNormal3f(x * zr1, y * zr1, z1);
-      glVertex3f(radius * x * zr1, radius * y * zr1, radius * z1);
+      m_sphere.addVertex(radius * x * zr, radius * y * zr, radius * z, x * zr,
+                         y * zr, z);
     }
-    glEnd();
   }
-}
 
-void Env::drawSquare(const float side) {
-  lineWidth(10.0);
+  const int row = longs + 1;
+  for (int i = 0; i <= lats; i++) {
+    for (int j = 0; j < longs; j++) {
+      Index a0 = i * row + j, a1 = (i + 1) * row + j;
+      Index b0 = a0 + 1, b1 = a1 + 1;
+      m_sphere.addIndex(a0);
+      m_sphere.addIndex(a1);
+      m_sphere.addIndex(b0);
+
+      m_sphere.addIndex(b0);
+      m_sphere.addIndex(a1);
+      m_sphere.addIndex(b1);
+    }
+  }
 
-  // line loop between the 4 vertex
-  glBegin(GL_LINE_LOOP);
-  glVertex3f(+side, +side, +side);
-  glVertex3f(-side, +side, +side);
-  glVertex3f(-side, -side, +side);
-  glVertex3f(+side, -side, +side);
-  glEnd();
+  return m_sphere;
 }
 
-// Draws a torus of inner radius r and outer radius R.
-void Env::drawTorus(double r, double R) {
+// Torus of inner radius r and outer radius R, tessellated once.
+// Same shape as the old quad strips (drawn at twice the radii, with the
+// unnormalized position as normal), as an indexed triangle list
+Geometry &Env::torus(double r, double R) {
   const static int NUM_C = 50;
   // number of vertex that approximates the circular ring shape
   const static int NUM_VERTEX_APPROX = 35;
   // length of the perimeter of the ring
   const static double RING_PERIMETER = 2.0 * M_PI;
-  double s, t, x, y, z;
-  double cos_phi, sin_phi, cos_teta, sin_teta;
-
-  for (size_t i = 0; i < NUM_C; ++i) {
-    glBegin(GL_QUAD_STRIP);
 
-    for (size_t j = 0; j <= NUM_VERTEX_APPROX; ++j) {
-      for (int k = 1; k >= 0; --k) {
-        s = (i + k) % NUM_C + 0.5;
-        t = j % NUM_VERTEX_APPROX;
+  if (!m_torus.empty() && m_torus_r == r && m_torus_R == R) {
+    return m_torus;
+  }
 
-        cos_phi = cos(s * RING_PERIMETER / NUM_C);
-        sin_phi = sin(s * RING_PERIMETER / NUM_C);
+  m_torus.clear();
+  m_torus_r = r;
+  m_torus_R = R;
 
-        cos_teta = cos(t * RING_PERIMETER / NUM_VERTEX_APPROX);
-        sin_teta = sin(t * RING_PERIMETER / NUM_VERTEX_APPROX);
+  // one vertex per (section, point on the section): the grid wraps around
+  // in both directions
+  for (int i = 0; i < NUM_C; ++i) {
+    double s = i + 0.5;
+    double cos_phi = cos(s * RING_PERIMETER / NUM_C);
+    double sin_phi = sin(s * RING_PERIMETER / NUM_C);
 
-        x = (R + r * cos_phi) * cos_teta;
-        y = (R + r * cos_phi) * sin_teta;
-        z = r * sin_phi;
+    for (int j = 0; j < NUM_VERTEX_APPROX; ++j) {
+      double cos_teta = cos(j * RING_PERIMETER / NUM_VERTEX_APPROX);
+      double sin_teta = sin(j * RING_PERIMETER / NUM_VERTEX_APPROX);
 
-        /*
-        double
-          n_x = cos_psi * cos_phi,
-          n_y = sin_psi * cos_phi,
-          n_z = sin_phi;
+      double x = (R + r * cos_phi) * cos_teta;
+      double y = (R + r * cos_phi) * sin_teta;
+      double z = r * sin_phi;
 
-        glNormal3d(n_x, n_y, n_z);*/
+      m_torus.addVertex(2 * x, 2 * y, 2 * z, x, y, z);
+    }
+  }
 
-        glNormal3d(x, y, z);
-        glVertex3d(2 * x, 2 * y, 2 * z);
-      }
+  auto index = [](int i, int j) {
+    return Index((i % NUM_C) * NUM_VERTEX_APPROX + j % NUM_VERTEX_APPROX);
+  };
+  for (int i = 0; i < NUM_C; ++i) {
+    for (int j = 0; j < NUM_VERTEX_APPROX; ++j) {
+      // the two triangles of the strip quad, same winding
+      m_torus.addIndex(index(i + 1, j));
+      m_torus.addIndex(index(i, j));
+      m_torus.addIndex(index(i + 1, j + 1));
+
+      m_torus.addIndex(index(i + 1, j + 1));
+      m_torus.addIndex(index(i, j));
+      m_torus.addIndex(index(i, j + 1));
     }
   }
 
-  glEnd();
+  return m_torus;
 }
 
-void Env::lineWidth(float width) { glLineWidth(width); }
+void Env::lineWidth(float width) { m_gl.lineWidth(width); }
 
 // Load texture from image file.
 // repeat == true --> GL_REPEAT for s and t coordinates
@@ -467,13 +379,21 @@ TexID Env::loadTexture(const char *filename, bool repeat, bool nearest) {
   SDL_Surface *s = IMG_Load(filename);
   if (!s) {
     lg::e(__func__, "Error while loading texture from file %s", filename);
-    return EXIT_FAILURE;
+    return 0; // the default texture
   }
 
+  TexID texbind = uploadTexture(s, repeat, nearest);
+  SDL_FreeSurface(s);
+  return texbind;
+}
+
+// GL half of loadTexture(): the image may have been decoded anywhere (e.g. by
+// the asset loader threads), the upload must happen on the GL thread
+TexID Env::uploadTexture(SDL_Surface *s, bool repeat, bool nearest) {
   TexID texbind;
   // generate a name for the texture (i.e. an unsigned int)
   glGenTextures(1, &texbind);
-  glBindTexture(GL_TEXTURE_2D, texbind);
+  m_gl.bindTexture(texbind);
   gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, s->w, s->h, GL_RGB, GL_UNSIGNED_BYTE,
                     s->pixels);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
@@ -514,7 +434,34 @@ void Env::render() {
   }
 
   // finally, the rendering we were all waiting for!
+  m_pacer.beginFrame();
+  auto cpu_start = threadCpuMs();
   m_render_handler();
+  m_cpu_time += threadCpuMs() - cpu_start;
+  m_cpu_frames++;
+
+  // culling counters of this frame, the next one needs a new frustum
+  m_frame_drawn = m_drawn;
+  m_frame_culled = m_culled;
+  m_drawn = m_culled = 0;
+  m_frustum_valid = false;
+
+  // average CPU time per frame, to keep an eye on rendering costs
+  if (m_cpu_report_time + CPU_TIME_REPORT < time_now) {
+    m_cpu_frame_ms = m_cpu_time / m_cpu_frames;
+    lg::i(__func__, "CPU time per frame: %.3f ms (%zu frames, %s pipeline)",
+          m_cpu_frame_ms, m_cpu_frames, isShaders() ? "GLSL" : "fixed");
+    // state changes that reached the driver vs. the redundant ones dropped
+    lg::i(__func__, "GL state changes per frame: %zu issued, %zu skipped",
+          m_gl.calls() / m_cpu_frames, m_gl.skipped() / m_cpu_frames);
+    m_gl.resetCounters();
+    m_pacer.report(__func__);
+    lg::i(__func__, "Objects in the last frame: %zu drawn, %zu culled",
+          m_frame_drawn, m_frame_culled);
+    m_cpu_time = 0.0;
+    m_cpu_frames = 0;
+    m_cpu_report_time = time_now;
+  }
 }
 
 // set environment variables to initial values
@@ -536,7 +483,7 @@ void Env::setCamera(double eye_x, double eye_y, double eye_z, double aim_x,
   gluLookAt(eye_x, eye_y, eye_z, aim_x, aim_y, aim_z, upX, upY, upZ);
 }
 
-void Env::setColor(const Color &c) { glColor4f(c.r, c.g, c.b, c.a); }
+void Env::setColor(const Color &c) { m_gl.color(c); }
 
 // setta le matrici di trasformazione in modo
 // che le coordinate in spazio oggetto siano le coord
@@ -552,16 +499,71 @@ void Env::setCoordToPixel() {
 
 void Env::setupLightPosition() {
   float light_position[4] = {0, 1, 2, 0}; // last component = 0 ==> directional light
-  glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+  m_gl.lightv(GL_LIGHT0, GL_POSITION, light_position);
+
+  // GL stores the light in eye space: do the same for the shaders
+  if (isShaders()) {
+    float eye[4];
+    toEyeSpace(light_position, eye);
+    m_shaders.setLight(eye);
+  }
+}
+
+void Env::setSpotLight(GLenum light, const SpotLight &spot) {
+  m_gl.enable(light);
+  m_gl.lightv(light, GL_DIFFUSE, spot.diffuse);
+  m_gl.lightv(light, GL_AMBIENT, spot.ambient);
+  m_gl.lightv(light, GL_POSITION, spot.position);
+  m_gl.lightv(light, GL_SPOT_DIRECTION, spot.direction);
+
+  // the spot parameters never change: set once, then skipped by the tracker
+  m_gl.lightf(light, GL_SPOT_CUTOFF, spot.cutoff);
+  m_gl.lightf(light, GL_SPOT_EXPONENT, spot.exponent);
+  m_gl.lightf(light, GL_CONSTANT_ATTENUATION, spot.constant_attenuation);
+  m_gl.lightf(light, GL_LINEAR_ATTENUATION, spot.linear_attenuation);
+
+  // same light for the shaders, in eye space
+  if (isShaders()) {
+    SpotLight eye = spot;
+    toEyeSpace(spot.position, eye.position);
+    toEyeSpace(spot.direction, eye.direction);
+    m_shaders.setSpot(&eye);
+  }
+}
+
+void Env::disableSpotLight(GLenum light) {
+  m_gl.disable(light);
+  if (isShaders()) {
+    m_shaders.setSpot(nullptr);
+  }
 }
 
 void Env::setupModelLights() {
   // setup lights for the model
   static float params[4] = {1, 1, 1, 1};
-  glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, params);
-  glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 127);
+  m_gl.materialv(GL_FRONT_AND_BACK, GL_SPECULAR, params);
+  m_gl.materialf(GL_FRONT_AND_BACK, GL_SHININESS, 127);
+  m_shaders.setSpecular(params, 127);
+
+  m_gl.enable(GL_LIGHTING);
+}
+
+void Env::updateFrustum() {
+  m_frustum.extract();
+  m_frustum_valid = true;
+}
+
+bool Env::isVisible(const Point3 &center, float radius) {
+  if (m_frustum_valid && !m_frustum.sphereInside(center, radius)) {
+    m_culled++;
+    return false;
+  }
+  m_drawn++;
+  return true;
+}
 
-  glEnable(GL_LIGHTING);
+float Env::viewDepth(const Point3 &point) const {
+  return m_frustum_valid ? m_frustum.depth(point) : 0.0f;
 }
 
 // Switches mode into GL_MODELVIEW, and then loads an identity matrix.
@@ -587,19 +589,18 @@ void Env::setupPersp() {
 void Env::textureDrawing(TexID texbind, std::function<void()> callback,
                          bool gen_coordinates) {
 
-  glBindTexture(GL_TEXTURE_2D, texbind);
-  glEnable(GL_TEXTURE_2D);
+  m_gl.bindTexture(texbind);
+  m_gl.enable(GL_TEXTURE_2D);
 
   // if the surface is complex, let OpenGL generate the coords for you
   if (gen_coordinates) {
-    glEnable(GL_TEXTURE_GEN_S);
-    glEnable(GL_TEXTURE_GEN_T);
+    m_gl.enable(GL_TEXTURE_GEN_S);
+    m_gl.enable(GL_TEXTURE_GEN_T);
   }
 
-  glTexGeni(GL_S, GL_TEXTURE_GEN_MODE,
-            m_envmap ? GL_SPHERE_MAP : GL_OBJECT_LINEAR); // EnvMap
-  glTexGeni(GL_T, GL_TEXTURE_GEN_MODE,
-            m_envmap ? GL_SPHERE_MAP : GL_OBJECT_LINEAR);
+  GLint mode = m_envmap ? GL_SPHERE_MAP : GL_OBJECT_LINEAR; // EnvMap
+  m_gl.texGen(GL_S, mode);
+  m_gl.texGen(GL_T, mode);
 
   setColor(WHITE); // avoid other colors to mess up the texture original color
 
@@ -607,12 +608,12 @@ void Env::textureDrawing(TexID texbind, std::function<void()> callback,
   callback();
 
   if (gen_coordinates) {
-    glDisable(GL_TEXTURE_GEN_T);
-    glDisable(GL_TEXTURE_GEN_S);
+    m_gl.disable(GL_TEXTURE_GEN_T);
+    m_gl.disable(GL_TEXTURE_GEN_S);
   }
 
   // disable texturing
-  glDisable(GL_TEXTURE_2D);
+  m_gl.disable(GL_TEXTURE_2D);
 }
 
 void Env::translate(float x, float y, float z) { glTranslatef(x, y, z); }
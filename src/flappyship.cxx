@@ -106,34 +106,14 @@ bool FlappyShip::updateVelocity() {
 // Flappy Render: 
 // It's almost the same but we need to tilt the nose of the ship according 
 // to the direction of the flight 
-void FlappyShip::render(bool flicker) {
-  m_env.mat_scope([&] {
-
-    // translate the camera to follow the ship movements
-    m_env.translate(m_px, m_py, m_pz);
-
-    // rotate the ship according to the facing direction
-    m_env.rotate(m_facing, m_viewUP);
-
-    // the Mesh is loaded on the other side
-    m_env.rotate(m_rotation_angle, m_viewUP);
-
-    // rotate the ship acc. to steering val, to represent tilting
-    auto sign = m_rotation_angle == ENVOS_ANGLE ? -1 : 1;
-    m_env.rotate(sign * m_steering, m_front_axis);
-
-    // rotate on the X-axis to represent tilting in flight mode, on the nose of
-    // the ship
-    agl::Vec3 Xaxis = agl::Vec3(1, 0, 0);
-    m_env.rotate(sign * m_steer_flight, Xaxis);
-
-    if (flicker) {
-      drawFlicker();
-    } else {
-      draw();
-    }
-
-  });
+void FlappyShip::transform() const {
+  Spaceship::transform();
+
+  // rotate on the X-axis to represent tilting in flight mode, on the nose of
+  // the ship
+  auto sign = m_rotation_angle == ENVOS_ANGLE ? -1 : 1;
+  agl::Vec3 Xaxis = agl::Vec3(1, 0, 0);
+  m_env.rotate(sign * m_steer_flight, Xaxis);
 }
 
 } // namespace elements
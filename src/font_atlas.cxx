@@ -0,0 +1,323 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+ * FontAtlas: signed distance fields of the glyphs of a TTF, rasterized on
+ * request.
+ *
+ * Each glyph is rasterized once at FONT_SDF_SIZE, padded by FONT_SDF_SPREAD
+ * pixels, and turned into distances from its edges with the 8-points
+ * sequential Euclidean distance transform (two sweeps over the bitmap, one
+ * for the inside and one for the outside). Distances are stored in 8 bits:
+ * 128 on the edge, 255 (0) at FONT_SDF_SPREAD pixels inside (outside).
+ * Drawn with an alpha test at 0.5 the edges stay sharp at any size.
+ *
+ * The fields go in the first free spot of the last page, and only that part
+ * of the page texture is updated. Glyphs added in a run are saved in the
+ * disk cache when the atlas is released: the next run starts with them.
+ * See agl.h
+ */
+
+namespace agl {
+
+namespace {
+// offset to the nearest "seed" pixel, for the distance transform
+struct Seed {
+  int dx, dy;
+  inline int dist2() const { return dx * dx + dy * dy; }
+};
+
+const Seed FAR_SEED = {10000, 10000};
+
+// propagate the seeds of the neighbours (8SSEDT)
+void sweep(std::vector<Seed> &grid, int w, int h) {
+  auto compare = [&](Seed &p, int x, int y, int ox, int oy) {
+    int nx = x + ox, ny = y + oy;
+    if (nx < 0 || ny < 0 || nx >= w || ny >= h) {
+      return;
+    }
+    Seed other = grid[ny * w + nx];
+    other.dx += ox;
+    other.dy += oy;
+    if (other.dist2() < p.dist2()) {
+      p = other;
+    }
+  };
+
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      Seed &p = grid[y * w + x];
+      compare(p, x, y, -1, 0);
+      compare(p, x, y, 0, -1);
+      compare(p, x, y, -1, -1);
+      compare(p, x, y, 1, -1);
+    }
+    for (int x = w - 1; x >= 0; --x) {
+      compare(grid[y * w + x], x, y, 1, 0);
+    }
+  }
+
+  for (int y = h - 1; y >= 0; --y) {
+    for (int x = w - 1; x >= 0; --x) {
+      Seed &p = grid[y * w + x];
+      compare(p, x, y, 1, 0);
+      compare(p, x, y, 0, 1);
+      compare(p, x, y, -1, 1);
+      compare(p, x, y, 1, 1);
+    }
+    for (int x = 0; x < w; ++x) {
+      compare(grid[y * w + x], x, y, -1, 0);
+    }
+  }
+}
+
+// distance field of a glyph surface, padded by FONT_SDF_SPREAD
+std::vector<GLubyte> distanceField(SDL_Surface *surface, int &w, int &h) {
+  const int pad = FONT_SDF_SPREAD;
+  w = surface->w + 2 * pad;
+  h = surface->h + 2 * pad;
+
+  // inside: seeds of the outer grid; outside: seeds of the inner one
+  std::vector<Seed> outer(w * h, FAR_SEED), inner(w * h, Seed{0, 0});
+  SDL_LockSurface(surface);
+  for (int y = 0; y < surface->h; ++y) {
+    auto row = reinterpret_cast<const Uint32 *>(
+        static_cast<const Uint8 *>(surface->pixels) + y * surface->pitch);
+    for (int x = 0; x < surface->w; ++x) {
+      Uint8 r, g, b, a;
+      SDL_GetRGBA(row[x], surface->format, &r, &g, &b, &a);
+      if (a >= 128) {
+        outer[(y + pad) * w + x + pad] = Seed{0, 0};
+        inner[(y + pad) * w + x + pad] = FAR_SEED;
+      }
+    }
+  }
+  SDL_UnlockSurface(surface);
+
+  sweep(outer, w, h);
+  sweep(inner, w, h);
+
+  std::vector<GLubyte> field(w * h);
+  for (int i = 0; i < w * h; ++i) {
+    // > 0 inside
+    float dist = std::sqrt(float(inner[i].dist2())) -
+                 std::sqrt(float(outer[i].dist2()));
+    float value = 0.5f + dist / (2.0f * FONT_SDF_SPREAD);
+    field[i] = GLubyte(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+  }
+  return field;
+}
+
+// The 32 bit glyph functions need SDL_ttf 2.0.18: older versions only have
+// the Basic Multilingual Plane (U+0000 - U+FFFF)
+#if SDL_TTF_MAJOR_VERSION > 2 ||                                               \
+    (SDL_TTF_MAJOR_VERSION == 2 &&                                             \
+     (SDL_TTF_MINOR_VERSION > 0 || SDL_TTF_PATCHLEVEL >= 18))
+bool glyphIsProvided(TTF_Font *font, uint32_t code) {
+  return TTF_GlyphIsProvided32(font, code);
+}
+
+void glyphMetrics(TTF_Font *font, uint32_t code, int *minx, int *maxx,
+                  int *miny, int *maxy, int *advance) {
+  TTF_GlyphMetrics32(font, code, minx, maxx, miny, maxy, advance);
+}
+
+SDL_Surface *renderGlyph(TTF_Font *font, uint32_t code, SDL_Color color) {
+  return TTF_RenderGlyph32_Blended(font, code, color);
+}
+#else
+bool glyphIsProvided(TTF_Font *font, uint32_t code) {
+  return code <= 0xFFFF && TTF_GlyphIsProvided(font, code);
+}
+
+void glyphMetrics(TTF_Font *font, uint32_t code, int *minx, int *maxx,
+                  int *miny, int *maxy, int *advance) {
+  TTF_GlyphMetrics(font, code, minx, maxx, miny, maxy, advance);
+}
+
+SDL_Surface *renderGlyph(TTF_Font *font, uint32_t code, SDL_Color color) {
+  return TTF_RenderGlyph_Blended(font, code, color);
+}
+#endif
+} // namespace
+
+// Glyph constructor
+Glyph::Glyph(uint32_t code, GLubyte minx, GLubyte maxx, GLubyte miny,
+             GLubyte maxy, GLubyte advance)
+    : m_code(code), m_u0(0), m_v0(0), m_u1(0), m_v1(0), m_minx(minx),
+      m_miny(miny), m_maxx(maxx), m_maxy(maxy), m_advance(advance),
+      m_width(0), m_page(0) {}
+
+void Glyph::place(GLubyte page, GLushort width, float u0, float v0, float u1,
+                  float v1) {
+  m_page = page;
+  m_width = width;
+  m_u0 = u0;
+  m_v0 = v0;
+  m_u1 = u1;
+  m_v1 = v1;
+}
+
+FontAtlas::FontAtlas(const char *font_path)
+    : m_path(font_path), m_font(nullptr), m_font_height(0), m_dirty(false) {}
+
+FontAtlas::~FontAtlas() {
+  if (m_dirty) {
+    saveCache();
+  }
+  if (m_font) {
+    TTF_CloseFont(m_font);
+  }
+  for (auto &page : m_pages) {
+    get_env().gl().deleteTexture(page.texture);
+  }
+}
+
+bool FontAtlas::openFont() {
+  static const auto TAG = __func__;
+
+  if (m_font) {
+    return true;
+  }
+
+  m_font = TTF_OpenFont(m_path.c_str(), FONT_SDF_SIZE);
+  if (!m_font) {
+    lg::e(TAG, "TTF_OpenFont: %s\n", TTF_GetError());
+    return false;
+  }
+
+  // disable kerning since it's not useful for this application
+  TTF_SetFontKerning(m_font, 0);
+  m_font_height = TTF_FontHeight(m_font);
+  return true;
+}
+
+const Glyph *FontAtlas::glyph(uint32_t code) {
+  auto it = m_glyphs.find(code);
+  if (it != m_glyphs.end()) {
+    return &it->second;
+  }
+
+  const Glyph *ret = rasterize(code);
+  if (!ret && code != '?') {
+    lg::e(__func__, "No glyph for U+%04X in %s", code, m_path.c_str());
+    ret = glyph('?');
+    // don't look for it again
+    if (ret) {
+      ret = &m_glyphs.emplace(code, *ret).first->second;
+    }
+  }
+  return ret;
+}
+
+const Glyph *FontAtlas::rasterize(uint32_t code) {
+  static const auto TAG = __func__;
+
+  if (!openFont() || !glyphIsProvided(m_font, code)) {
+    return nullptr;
+  }
+
+  int miny, maxy, advance, minx, maxx;
+  glyphMetrics(m_font, code, &minx, &maxx, &miny, &maxy, &advance);
+  Glyph glyph(code, minx, maxx, miny, maxy, advance);
+
+  // Render the glyph on a surface as Blended, then its distances
+  SDL_Color color = {255, 255, 255, 255};
+  SDL_Surface *surface = renderGlyph(m_font, code, color);
+  if (!surface) {
+    lg::e(TAG, "%s\n", TTF_GetError());
+    return nullptr;
+  }
+  int w, h;
+  std::vector<GLubyte> field = distanceField(surface, w, h);
+  SDL_FreeSurface(surface);
+
+  if (w > FONT_PAGE_SIZE || h > FONT_PAGE_SIZE) {
+    lg::e(TAG, "Glyph U+%04X too big for the atlas", code);
+    return nullptr;
+  }
+
+  // place it on the current row, or start a new one, or a new page. The
+  // padding of the fields keeps the glyphs apart
+  FontPage *page = m_pages.empty() ? &newPage() : &m_pages.back();
+  if (page->x + w > FONT_PAGE_SIZE) {
+    page->x = 0;
+    page->y += page->row_height;
+    page->row_height = 0;
+  }
+  if (page->y + h > FONT_PAGE_SIZE) {
+    page = &newPage();
+  }
+  int x = page->x, y = page->y;
+  page->x += w;
+  page->row_height = std::max(page->row_height, h);
+
+  for (int row = 0; row < h; ++row) {
+    std::copy(field.begin() + row * w, field.begin() + (row + 1) * w,
+              page->pixels.begin() + (y + row) * FONT_PAGE_SIZE + x);
+  }
+
+  // only the new glyph goes to the GPU
+  get_env().gl().bindTexture(page->texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_ALPHA, GL_UNSIGNED_BYTE,
+                  field.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  const float size = FONT_PAGE_SIZE;
+  glyph.place(m_pages.size() - 1, w, x / size, y / size, (x + w) / size,
+              (y + h) / size);
+  m_dirty = true;
+  return &m_glyphs.emplace(code, glyph).first->second;
+}
+
+FontPage &FontAtlas::newPage() {
+  m_pages.emplace_back();
+  FontPage &page = m_pages.back();
+  page.pixels.assign(FONT_PAGE_SIZE * FONT_PAGE_SIZE, 0);
+  page.texture = 0;
+  page.x = page.y = page.row_height = 0;
+  upload(page);
+
+  lg::i(__func__, "Font atlas of %s: page %zu", m_path.c_str(),
+        m_pages.size());
+  return page;
+}
+
+void FontAtlas::upload(FontPage &page) {
+  // generate texture ID
+  glGenTextures(1, &page.texture);
+  get_env().gl().bindTexture(page.texture);
+
+  // one byte per texel: rows aren't 4-aligned in general
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, FONT_PAGE_SIZE, FONT_PAGE_SIZE, 0,
+               GL_ALPHA, GL_UNSIGNED_BYTE, page.pixels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
+
+std::unique_ptr<FontAtlas> loadFontAtlas(const char *font_path) {
+  static const auto TAG = __func__;
+
+  std::unique_ptr<FontAtlas> ret(new FontAtlas(font_path));
+  if (ret->loadCache()) {
+    lg::i(TAG, "Font atlas of %s loaded from cache: %zu glyphs", font_path,
+          ret->m_glyphs.size());
+    return ret;
+  }
+
+  // only the metrics of the font, no glyphs yet
+  if (!ret->openFont()) {
+    exit(EXIT_FAILURE);
+  }
+  return ret;
+}
+
+} // namespace agl
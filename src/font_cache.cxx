@@ -0,0 +1,208 @@
+#include "agl.h"
+
+#include <string>
+#include <type_traits>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Binary FontAtlas cache.
+ * The distance fields are the slow part of loading a font: the glyphs
+ * rasterized in a run are dumped next to the font as "<font_path>.aglfont"
+ * and read back by the next loadFontAtlas().
+ *
+ * Layout (native endianness):
+ *   FontCacheHeader
+ *   n_glyphs x Glyph
+ *   n_pages x [PageCursor, FONT_PAGE_SIZE^2 bytes of distances]
+ *
+ * As for meshes, size and mtime of the font file are checked: a different
+ * font makes the sidecar stale.
+ */
+
+namespace agl {
+
+namespace {
+static const char CACHE_MAGIC[8] = {'A', 'G', 'L', 'F', 'O', 'N', 'T', '\0'};
+static const uint32_t CACHE_VERSION = 3;
+static const char *CACHE_EXT = ".aglfont";
+
+struct FontCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t sdf_size, sdf_spread, page_size; // the field depends on them
+  uint32_t n_glyphs, n_pages;
+  int32_t font_height;
+  uint64_t src_size;
+  int64_t src_mtime_sec, src_mtime_nsec;
+};
+
+// next free spot of a page
+struct PageCursor {
+  int32_t x, y, row_height;
+};
+
+static_assert(std::is_trivially_copyable<Glyph>::value,
+              "Glyph must be trivially copyable to be cached");
+
+// size of the whole cache file for the given header. 64 bit: the counts come
+// from the file and must not wrap around
+inline uint64_t cacheSize(const FontCacheHeader &hdr) {
+  return sizeof(FontCacheHeader) + uint64_t(sizeof(Glyph)) * hdr.n_glyphs +
+         uint64_t(sizeof(PageCursor) + FONT_PAGE_SIZE * FONT_PAGE_SIZE) *
+             hdr.n_pages;
+}
+
+// fill the source file fields of the header, false if the font is missing
+bool statSource(const char *font_path, FontCacheHeader &hdr) {
+  struct stat st;
+  if (stat(font_path, &st) < 0) {
+    return false;
+  }
+
+  hdr.src_size = st.st_size;
+  hdr.src_mtime_sec = st.st_mtim.tv_sec;
+  hdr.src_mtime_nsec = st.st_mtim.tv_nsec;
+  return true;
+}
+} // namespace
+
+// Return false if there's no valid cache for the font
+bool FontAtlas::loadCache() {
+  static const auto TAG = __func__;
+
+  FontCacheHeader src;
+  if (!statSource(m_path.c_str(), src)) {
+    return false;
+  }
+
+  std::string cache_filename = m_path + CACHE_EXT;
+  FILE *file = std::fopen(cache_filename.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+
+  // the counts are checked against the file size before anything is
+  // allocated for them
+  struct stat st;
+  FontCacheHeader hdr;
+  bool valid =
+      fstat(fileno(file), &st) == 0 &&
+      std::fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+      std::memcmp(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+      hdr.version == CACHE_VERSION && hdr.sdf_size == FONT_SDF_SIZE &&
+      hdr.sdf_spread == FONT_SDF_SPREAD && hdr.page_size == FONT_PAGE_SIZE &&
+      hdr.src_size == src.src_size && hdr.src_mtime_sec == src.src_mtime_sec &&
+      hdr.src_mtime_nsec == src.src_mtime_nsec &&
+      cacheSize(hdr) == uint64_t(st.st_size);
+
+  std::vector<Glyph> glyphs;
+  if (valid) {
+    glyphs.resize(hdr.n_glyphs);
+    valid = std::fread(glyphs.data(), sizeof(Glyph), glyphs.size(), file) ==
+            glyphs.size();
+
+    m_pages.resize(hdr.n_pages);
+    for (auto &page : m_pages) {
+      PageCursor cursor;
+      page.pixels.resize(FONT_PAGE_SIZE * FONT_PAGE_SIZE);
+      page.texture = 0;
+      valid = valid && std::fread(&cursor, sizeof(cursor), 1, file) == 1 &&
+              std::fread(page.pixels.data(), 1, page.pixels.size(), file) ==
+                  page.pixels.size();
+      page.x = cursor.x;
+      page.y = cursor.y;
+      page.row_height = cursor.row_height;
+    }
+
+    for (const auto &glyph : glyphs) {
+      valid = valid && glyph.get_page() < m_pages.size();
+    }
+    if (!valid) {
+      lg::e(TAG, "Corrupted font cache %s", cache_filename.c_str());
+    }
+  }
+  std::fclose(file);
+
+  if (!valid) {
+    m_pages.clear();
+    return false;
+  }
+
+  for (const auto &glyph : glyphs) {
+    m_glyphs.emplace(glyph.get_code(), glyph);
+  }
+  for (auto &page : m_pages) {
+    upload(page);
+  }
+  m_font_height = hdr.font_height;
+  return true;
+}
+
+// Failures are not fatal: the glyphs will simply be rasterized again
+void FontAtlas::saveCache() const {
+  static const auto TAG = __func__;
+
+  FontCacheHeader hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  if (!statSource(m_path.c_str(), hdr)) {
+    return;
+  }
+
+  std::memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  hdr.version = CACHE_VERSION;
+  hdr.sdf_size = FONT_SDF_SIZE;
+  hdr.sdf_spread = FONT_SDF_SPREAD;
+  hdr.page_size = FONT_PAGE_SIZE;
+  hdr.n_glyphs = m_glyphs.size();
+  hdr.n_pages = m_pages.size();
+  hdr.font_height = m_font_height;
+
+  // write to a temporary file and rename it, so that a concurrent load
+  // never sees a half-written cache. Unique name, as for meshes: another
+  // game instance may be saving the same font
+  std::string cache_filename = m_path + CACHE_EXT;
+  std::string tmp_filename = cache_filename + ".XXXXXX";
+
+  FILE *file = nullptr;
+  int fd = mkstemp(&tmp_filename[0]);
+  if (fd >= 0) {
+    // mkstemp creates it readable by the owner only
+    fchmod(fd, 0644);
+    file = fdopen(fd, "wb");
+    if (!file) {
+      close(fd);
+      std::remove(tmp_filename.c_str());
+    }
+  }
+  if (!file) {
+    lg::e(TAG, "Cannot write font cache %s", cache_filename.c_str());
+    return;
+  }
+
+  std::fwrite(&hdr, sizeof(hdr), 1, file);
+  for (const auto &entry : m_glyphs) {
+    std::fwrite(&entry.second, sizeof(Glyph), 1, file);
+  }
+  for (const auto &page : m_pages) {
+    PageCursor cursor = {page.x, page.y, page.row_height};
+    std::fwrite(&cursor, sizeof(cursor), 1, file);
+    std::fwrite(page.pixels.data(), 1, page.pixels.size(), file);
+  }
+
+  bool ok = !std::ferror(file);
+  ok = (std::fclose(file) == 0) && ok;
+
+  if (!ok || std::rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    lg::e(TAG, "Cannot write font cache %s", cache_filename.c_str());
+    std::remove(tmp_filename.c_str());
+  }
+}
+
+} // namespace agl
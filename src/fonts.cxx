@@ -1,180 +1,253 @@
 #include "agl.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
 namespace agl {
 
-// Glyph constructor
-Glyph::Glyph(char letter, TexID textureID, GLubyte minx, GLubyte maxx,
-             GLubyte miny, GLubyte maxy, GLubyte advance)
-    : m_letter(letter), m_texID(textureID), m_minx(minx), m_miny(miny),
-      m_maxx(maxx), m_maxy(maxy), m_advance(advance) {}
+namespace {
+// 4 corners x (x, y, u, v)
+const size_t QUAD_FLOATS = 16;
+// edge of the glyphs in the distance field
+const GLfloat SDF_THRESHOLD = 0.5f;
+// decoding errors show up as this
+const uint32_t REPLACEMENT_CHAR = 0xFFFD;
+
+// decode the UTF-8 sequence at str and move past it. Malformed sequences
+// give REPLACEMENT_CHAR and skip one byte
+uint32_t nextCodePoint(const char *&str) {
+  auto s = reinterpret_cast<const unsigned char *>(str);
+  uint32_t code;
+  int len;
+  if (s[0] < 0x80) {
+    code = s[0];
+    len = 1;
+  } else if ((s[0] & 0xE0) == 0xC0) {
+    code = s[0] & 0x1F;
+    len = 2;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    code = s[0] & 0x0F;
+    len = 3;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    code = s[0] & 0x07;
+    len = 4;
+  } else {
+    str++;
+    return REPLACEMENT_CHAR;
+  }
 
-// TextRenderer: return unique pointer referring to a font wt specific size
-std::unique_ptr<AGLTextRenderer> getTextRenderer(const char *font_path,
-                                                 size_t font_size) {
-  const static auto TAG = __func__;
-  lg::i(TAG, "Creating a text renderer, loading the font %s with size %zu",
-        font_path, font_size);
+  for (int i = 1; i < len; ++i) {
+    // also stops at the terminator
+    if ((s[i] & 0xC0) != 0x80) {
+      str++;
+      return REPLACEMENT_CHAR;
+    }
+    code = (code << 6) | (s[i] & 0x3F);
+  }
 
-  return std::unique_ptr<AGLTextRenderer>(
-      new AGLTextRenderer(font_path, font_size));
+  // overlong encodings, surrogates and out of range
+  static const uint32_t MIN_CODE[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (code < MIN_CODE[len] || code > 0x10FFFF ||
+      (code >= 0xD800 && code <= 0xDFFF)) {
+    str++;
+    return REPLACEMENT_CHAR;
+  }
+
+  str += len;
+  return code;
 }
+} // namespace
 
-AGLTextRenderer::AGLTextRenderer(const char *font_path, size_t font_size)
-    : m_env(agl::get_env()) {
-  const static auto TAG = __func__;
+void TextBatch::clear() {
+  quads.clear();
+  pages.clear();
+  runs.clear();
+}
 
-  // Init font for text drawing
-  if (TTF_Init() == -1) {
-    lg::e(TAG, "Cannot init font %s", font_path);
-    exit(EXIT_FAILURE);
+void TextBatch::finish() {
+  runs.clear();
+  if (pages.empty()) {
+    return;
   }
 
-  m_font_ptr = TTF_OpenFont(font_path, font_size);
-  if (!m_font_ptr) {
-    lg::e(TAG, "TTF_OpenFont: %s\n", TTF_GetError());
+  GLubyte first = pages[0], last = pages[0];
+  for (auto page : pages) {
+    first = std::min(first, page);
+    last = std::max(last, page);
   }
 
-  // disable kerning since it's not useful for this application
-  TTF_SetFontKerning(m_font_ptr, 0);
-
-  // get font m_font_outline
-  m_font_outline = TTF_GetFontOutline(m_font_ptr);
-  m_font_height = TTF_FontHeight(m_font_ptr);
-  loadTextureVector();
-}
+  // nearly always a single page
+  if (first == last) {
+    runs.push_back(TextRun{first, 0, GLsizei(vertices())});
+    return;
+  }
 
-void AGLTextRenderer::loadTextureVector() {
-  static const auto TAG = __func__;
-  SDL_Surface *surface;
-  SDL_Color color = {255, 255, 255, 255};
-
-  int miny, maxy, advance, minx, maxx;
-  agl::TexID texbind;
-  // for (char i = ASCII_SPACE_CODE; i < ASCII_DEL_CODE; ++i) {
-  for (char ch = ' '; ch < '~'; ++ch) {
-    // cache glyph metrics and texture
-    TTF_GlyphMetrics(m_font_ptr, ch, &minx, &maxx, &miny, &maxy, &advance);
-
-    // Render the font on a surface as Blended : slower but high quality
-    // if performance is suffering, try switch to Solid
-    if (!(surface = TTF_RenderGlyph_Blended(m_font_ptr, ch, color))) {
-      lg::e(TAG, "%s\n", TTF_GetError());
+  // otherwise sort the quads by page, keeping their order in each page
+  sorted.clear();
+  for (GLuint page = first; page <= last; ++page) {
+    GLint start = sorted.size() / 4;
+    for (size_t i = 0; i < pages.size(); ++i) {
+      if (pages[i] == page) {
+        sorted.insert(sorted.end(), quads.begin() + i * QUAD_FLOATS,
+                      quads.begin() + (i + 1) * QUAD_FLOATS);
+      }
     }
+    GLsizei count = sorted.size() / 4 - start;
+    if (count > 0) {
+      runs.push_back(TextRun{page, start, count});
+    }
+  }
+  quads.swap(sorted);
+}
 
-    // generate texture ID
-    glGenTextures(1, &texbind);
-
-    glBindTexture(GL_TEXTURE_2D, texbind);
-    // create Texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, surface->w, surface->h, 0, GL_RGBA,
-                 GL_UNSIGNED_BYTE, surface->pixels);
+// TextRenderer: return unique pointer referring to a font wt specific size
+std::unique_ptr<AGLTextRenderer> getTextRenderer(const char *font_path,
+                                                 size_t font_size) {
+  const static auto TAG = __func__;
+  lg::i(TAG, "Creating a text renderer, loading the font %s with size %zu",
+        font_path, font_size);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  return std::unique_ptr<AGLTextRenderer>(
+      new AGLTextRenderer(font_path, font_size));
+}
 
-    // create Glyph
-    Glyph glyph(ch, texbind, minx, maxx, miny, maxy, advance);
-    // append glyph texture at the end of the atlas
-    m_glyphs.push_back(glyph);
-    SDL_FreeSurface(surface);
-  }
+// the glyphs come from the shared atlas, scaled to font_size
+AGLTextRenderer::AGLTextRenderer(const char *font_path, size_t font_size)
+    : m_atlas(getFont(font_path)), m_scale(float(font_size) / FONT_SDF_SIZE),
+      m_env(agl::get_env()) {
+  m_font_height = std::lround(m_atlas->get_height() * m_scale);
 }
 
 // Reminder: x_o, y_o is the top-left origin
 int AGLTextRenderer::render(int x_o, int y_o, const char *str) {
-  // for (; *str; ++str)
-  for (const char *c = str; (*c) != '\0'; ++c) {
-    renderChar(x_o, y_o, *c);
-    // get next x_o-position
-    x_o += get_glyph_at(*c).get_advance();
-  }
+  m_batch.clear();
+  x_o = layout(x_o, y_o, str, m_batch);
+  drawBatch(m_batch, m_batch.quads.data());
 
   // return end of the string
   return x_o;
 }
 
-int AGLTextRenderer::render(int x_o, int y_o, std::string &str) {
+int AGLTextRenderer::layout(int x_o, int y_o, const char *str,
+                            TextBatch &batch) {
+  // fractional advances, rounded once at the end
+  float x = x_o;
+  for (const char *c = str; (*c) != '\0';) {
+    const Glyph *glyph = m_atlas->glyph(nextCodePoint(c));
+    if (glyph) {
+      x = layoutGlyph(x, y_o, *glyph, batch);
+    }
+  }
+  batch.finish();
+  return std::lround(x);
+}
+
+int AGLTextRenderer::render(int x_o, int y_o, const std::string &str) {
   return render(x_o, y_o, str.c_str());
 }
 
 int AGLTextRenderer::renderf(int x_o, int y_o, const char *fmt, ...) {
-  std::va_list ap;
+  std::va_list ap, ap_len;
   // process argument list
   va_start(ap, fmt);
-
-  char *buf; //= nullptr;
-  vasprintf(&buf, fmt, ap);
+  va_copy(ap_len, ap);
+
+  // format in the reused buffer, grown only when too short
+  int len = std::vsnprintf(nullptr, 0, fmt, ap_len);
+  va_end(ap_len);
+  if (len < 0) {
+    va_end(ap);
+    return x_o;
+  }
+  if (m_format.size() < size_t(len) + 1) {
+    m_format.resize(len + 1);
+  }
+  std::vsnprintf(m_format.data(), m_format.size(), fmt, ap);
 
   va_end(ap);
 
   // finally call the render function
-  int ret = render(x_o, y_o, buf);
-  std::free(buf);
-
-  return ret;
+  return render(x_o, y_o, m_format.data());
 }
 
 // Reminder: x_o, y_o is the top-left origin
-// Get Glyph -
-void AGLTextRenderer::renderChar(int x_o, int y_o, char letter) {
-  // check on letter
-  if (letter > '~' || letter < ' ') {
-    lg::e(__func__, "Out of range char");
+float AGLTextRenderer::layoutGlyph(float x_o, int y_o, const Glyph &glyph,
+                                   TextBatch &batch) {
+  // the bitmap in the atlas is padded by the spread of the field
+  GLfloat pad = FONT_SDF_SPREAD * m_scale;
+  GLfloat left = x_o - pad;
+  GLfloat right = left + glyph.get_width() * m_scale;
+  GLfloat bottom = y_o - pad;
+  GLfloat top = y_o + m_atlas->get_height() * m_scale + pad;
+
+  // the top row of the glyph is v0
+  const GLfloat quad[QUAD_FLOATS] = {
+      left,  top,    glyph.get_u0(), glyph.get_v0(), // top-left
+      left,  bottom, glyph.get_u0(), glyph.get_v1(), // bottom-left
+      right, bottom, glyph.get_u1(), glyph.get_v1(), // bottom-right
+      right, top,    glyph.get_u1(), glyph.get_v0(), // top-right
+  };
+  batch.quads.insert(batch.quads.end(), quad, quad + QUAD_FLOATS);
+  batch.pages.push_back(glyph.get_page());
+
+  // get next x_o-position
+  return x_o + glyph.get_advance() * m_scale;
+}
+
+// all the quads of the string with one state setup, one draw call per page
+void AGLTextRenderer::drawBatch(const TextBatch &batch, const GLfloat *base) {
+  if (batch.runs.empty()) {
+    return;
   }
 
-  Glyph glyph = get_glyph_at(letter);
+  auto &gl = m_env.gl();
 
   // We want to draw text over our scene, so no need of Depth Testing
-  glDisable(GL_DEPTH_TEST);
-  glDisable(GL_LIGHTING);
+  gl.disable(GL_DEPTH_TEST);
+  gl.disable(GL_LIGHTING);
 
-  // Blending
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  // the alpha of the texture is the distance from the edge: cut it there
+  gl.enable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GEQUAL, SDF_THRESHOLD);
 
   // Texture
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, glyph.get_textureID());
-
-  // Draw texture with quads
-  glBegin(GL_QUADS);
-  {
-    // bottom-left
-    glTexCoord2f(0, 0);
-    glVertex2f(x_o - m_font_outline, (y_o + m_font_height - m_font_outline));
-
-    // top-left
-    glTexCoord2f(0, 1);
-    glVertex2f(x_o - m_font_outline, y_o - m_font_outline);
-
-    // top-right
-    glTexCoord2f(1, 1);
-    glVertex2f((x_o + glyph.get_maxX() - m_font_outline),
-               (y_o - m_font_outline));
-
-    // bottom-right
-    glTexCoord2f(1, 0);
-    glVertex2f((x_o + glyph.get_maxX() - m_font_outline),
-               (y_o + m_font_height - m_font_outline));
+  gl.enable(GL_TEXTURE_2D);
+
+  const GLsizei stride = 4 * sizeof(GLfloat);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, stride, base);
+  glTexCoordPointer(2, GL_FLOAT, stride, base + 2);
+
+  for (const auto &run : batch.runs) {
+    gl.bindTexture(m_atlas->texture(run.page));
+    glDrawArrays(GL_QUADS, run.first, run.count);
   }
 
-  glEnd();
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
 
-  glDisable(GL_TEXTURE_2D);
-  glDisable(GL_BLEND);
+  gl.disable(GL_TEXTURE_2D);
+  gl.disable(GL_ALPHA_TEST);
   // Renable Z-buffer and Lighting
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_LIGHTING);
+  gl.enable(GL_DEPTH_TEST);
+  gl.enable(GL_LIGHTING);
 }
 
 int AGLTextRenderer::get_width(const char *str) {
-  int width;
-  TTF_SizeText(m_font_ptr, str, &width, NULL);
-  return width;
+  float width = 0.0f;
+  for (const char *c = str; (*c) != '\0';) {
+    const Glyph *glyph = m_atlas->glyph(nextCodePoint(c));
+    if (glyph) {
+      width += glyph->get_advance() * m_scale;
+    }
+  }
+  return std::lround(width);
 }
 
-AGLTextRenderer::~AGLTextRenderer() { TTF_CloseFont(m_font_ptr); }
+// the atlas goes with its last renderer
+AGLTextRenderer::~AGLTextRenderer() {}
 
 } // namespace agl
@@ -0,0 +1,141 @@
+#include "agl.h"
+
+#include <thread>
+
+/*
+ * FramePacer: swap interval, frames in flight and FPS cap.
+ * The CPU is allowed to get ahead of the GPU by a few frames, instead of
+ * waiting for each frame to be finished before swapping: a fence is inserted
+ * after every swap, and only the oldest one is waited for when too many
+ * frames are queued. See agl.h
+ */
+
+namespace agl {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+// longest wait for a frame, in ns
+const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+} // namespace
+
+FramePacer::FramePacer()
+    : m_mode(SwapMode::ADAPTIVE), m_fps_cap(0.0), m_max_frames(2),
+      m_frame_start(Clock::now()), m_next_frame(m_frame_start),
+      m_submit_ms(0.0), m_gpu_wait_ms(0.0), m_sleep_ms(0.0), m_frames(0),
+      m_total_submit_ms(0.0), m_total_gpu_wait_ms(0.0), m_total_sleep_ms(0.0) {}
+
+FramePacer::~FramePacer() { release(); }
+
+void FramePacer::release() {
+  for (auto fence : m_fences) {
+    glDeleteSync(fence);
+  }
+  m_fences.clear();
+}
+
+bool FramePacer::supported() { return GLEW_VERSION_3_2 || GLEW_ARB_sync; }
+
+// needs the GL context: call it once the window is created
+void FramePacer::applySwapMode() {
+  static const auto TAG = __func__;
+
+  switch (m_mode) {
+  case SwapMode::ADAPTIVE:
+    // late frames are shown right away instead of waiting for the next sync
+    lg::i(TAG, "Try to enable adaptive VSync...");
+    if (SDL_GL_SetSwapInterval(-1) == 0) {
+      break;
+    }
+    lg::i(TAG, "Adaptive VSync not available. Trying for normal vsync...");
+  // fall through
+  case SwapMode::VSYNC:
+    if (SDL_GL_SetSwapInterval(1) < 0) {
+      lg::i(TAG, "VSync not available!");
+    }
+    break;
+  case SwapMode::UNCAPPED:
+    lg::i(TAG, "VSync disabled");
+    SDL_GL_SetSwapInterval(0);
+    break;
+  }
+
+  if (!supported()) {
+    lg::i(TAG, "No GL sync objects: frames in flight are up to the driver");
+  }
+}
+
+void FramePacer::beginFrame() { m_frame_start = Clock::now(); }
+
+void FramePacer::present(SDL_Window *window) {
+  static const auto TAG = __func__;
+
+  auto submitted = Clock::now();
+  SDL_GL_SwapWindow(window);
+
+  // wait for the GPU only when too far behind
+  auto wait_start = Clock::now();
+  if (supported()) {
+    m_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    while (m_fences.size() > m_max_frames) {
+      GLsync fence = m_fences.front();
+      m_fences.pop_front();
+      // wait at most FENCE_TIMEOUT_NS: a lost fence must not hang the game
+      switch (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                               FENCE_TIMEOUT_NS)) {
+      case GL_TIMEOUT_EXPIRED:
+        lg::w(TAG, "Frame fence not signaled after %.0f ms, dropped",
+              FENCE_TIMEOUT_NS / 1e6);
+        break;
+      case GL_WAIT_FAILED:
+        lg::e(TAG, "Waiting for a frame fence failed (0x%x)", glGetError());
+        break;
+      default:
+        // GL_ALREADY_SIGNALED or GL_CONDITION_SATISFIED
+        break;
+      }
+      glDeleteSync(fence);
+    }
+  }
+  auto wait_end = Clock::now();
+
+  // FPS cap: sleep till the next slot. A frame late by more than a whole
+  // period restarts the schedule, rather than rushing to catch up
+  if (m_fps_cap > 0.0) {
+    auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / m_fps_cap));
+    m_next_frame += period;
+    if (m_next_frame + period < wait_end) {
+      m_next_frame = wait_end;
+    }
+    std::this_thread::sleep_until(m_next_frame);
+  }
+  auto frame_end = Clock::now();
+
+  m_submit_ms = elapsed_ms(m_frame_start, submitted);
+  m_gpu_wait_ms = elapsed_ms(wait_start, wait_end);
+  m_sleep_ms = elapsed_ms(wait_end, frame_end);
+
+  m_frames++;
+  m_total_submit_ms += m_submit_ms;
+  m_total_gpu_wait_ms += m_gpu_wait_ms;
+  m_total_sleep_ms += m_sleep_ms;
+}
+
+void FramePacer::report(const char *tag) {
+  if (m_frames == 0) {
+    return;
+  }
+
+  lg::i(tag, "Frame pacing: submit %.3f ms, GPU wait %.3f ms, sleep %.3f ms",
+        m_total_submit_ms / m_frames, m_total_gpu_wait_ms / m_frames,
+        m_total_sleep_ms / m_frames);
+  m_frames = 0;
+  m_total_submit_ms = m_total_gpu_wait_ms = m_total_sleep_ms = 0.0;
+}
+
+} // namespace agl
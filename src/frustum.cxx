@@ -0,0 +1,73 @@
+#include "agl.h"
+
+#include <cmath>
+
+/*
+ * Frustum: the six planes of the camera view volume, used to skip whatever
+ * lies entirely outside of it. See agl.h
+ */
+
+namespace agl {
+
+Frustum::Frustum() {
+  // no planes yet: everything is inside
+  for (auto &plane : m_planes) {
+    plane[0] = plane[1] = plane[2] = 0.0f;
+    plane[3] = 1.0f;
+  }
+}
+
+// Planes are taken straight from the rows of projection * modelview (Gribb &
+// Hartmann): with the modelview holding only the camera, they are in world
+// coordinates
+void Frustum::extract() {
+  double proj[16], model[16], clip[16];
+  glGetDoublev(GL_PROJECTION_MATRIX, proj);
+  glGetDoublev(GL_MODELVIEW_MATRIX, model);
+
+  // column major, as GL stores them
+  for (size_t c = 0; c < 4; ++c) {
+    for (size_t r = 0; r < 4; ++r) {
+      clip[c * 4 + r] = 0.0;
+      for (size_t k = 0; k < 4; ++k) {
+        clip[c * 4 + r] += proj[k * 4 + r] * model[c * 4 + k];
+      }
+    }
+  }
+
+  // left, right, bottom, top, near, far: row 3 +/- rows 0, 1, 2
+  for (size_t i = 0; i < 6; ++i) {
+    size_t row = i / 2;
+    double sign = (i % 2) ? -1.0 : 1.0;
+    double plane[4];
+    for (size_t c = 0; c < 4; ++c) {
+      plane[c] = clip[c * 4 + 3] + sign * clip[c * 4 + row];
+    }
+
+    // normalized, so that the distance from a plane is in world units
+    double len = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+                           plane[2] * plane[2]);
+    for (size_t c = 0; c < 4; ++c) {
+      m_planes[i][c] = plane[c] / len;
+    }
+  }
+}
+
+bool Frustum::sphereInside(const Point3 &center, float radius) const {
+  for (const auto &plane : m_planes) {
+    if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z +
+            plane[3] <
+        -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+float Frustum::depth(const Point3 &point) const {
+  const auto &plane = m_planes[4]; // near
+  return plane[0] * point.x + plane[1] * point.y + plane[2] * point.z +
+         plane[3];
+}
+
+} // namespace agl
@@ -10,14 +10,57 @@ Game::Game(std::string gameID, size_t num_rings)
       m_deadline_time(0.0), m_final_stage(false), m_last_time(.0),
       m_penalty_time(0.0), m_num_rings(num_rings), m_env(agl::get_env()),
       m_num_cubes(10), m_main_win(nullptr), m_floor(nullptr), m_sky(nullptr),
-      m_final_door(nullptr), m_ssh(nullptr) {}
+      m_final_door(nullptr), m_ssh(nullptr), m_ship_texture(nullptr),
+      m_ship_mesh(nullptr) {}
+
+// floor and sky are static singletons: their textures must be freed before
+// m_main_win deletes the GL context
+Game::~Game() {
+  m_floor = nullptr;
+  m_sky = nullptr;
+  elements::release_floor();
+  elements::release_sky();
+}
 
 /*
  * Init the game:
- * 1. Obtain main window from the environment
- * 2. Load textures and mesh
+ * 1. Start loading textures and meshes on the loader threads
+ * 2. Obtain main window from the environment
+ * 3. Show the splash screen as soon as its texture is ready
+ * 4. Collect the rest of the assets, as they get ready
  */
 void Game::init() {
+  m_easter_egg = m_gameID == "Truman";
+
+  const char *floor_tex, *sky_tex, *splash_tex;
+  const char *door_mesh = "Mesh/porta.obj", *door_tex = "Texture/wop4.jpg";
+  if (m_easter_egg) {
+    floor_tex = "Texture/truman-texture.jpg";
+    sky_tex = "Texture/truman.jpg";
+    splash_tex = "Texture/splash3.jpg";
+    m_ship_texture = "Texture/wood1.jpg";
+    m_ship_mesh = "Mesh/boat.obj";
+  } else {
+    floor_tex = "Texture/tex2.jpg";
+    sky_tex = "Texture/space1.jpg";
+    splash_tex = "Texture/splash2.jpg";
+    m_ship_texture = "Texture/tex5.jpg";
+    m_ship_mesh = "Mesh/Envos.obj";
+  }
+
+  // images are decoded and meshes parsed in parallel, in this order, while
+  // this thread creates the window and the fonts. Each get_*() below only
+  // waits for its own asset
+  agl::prefetchTexture(splash_tex);
+  agl::prefetchTexture(floor_tex, true, false);
+  agl::prefetchTexture(sky_tex, false);
+  agl::prefetchTexture("Texture/menu.jpg");
+  agl::prefetchTexture(m_ship_texture);
+  agl::prefetchMesh(m_ship_mesh, true);
+  if (m_easter_egg) {
+    agl::prefetchTexture(door_tex);
+    agl::prefetchMesh(door_mesh, true);
+  }
 
   std::string win_name = "Main Window";
   m_main_win = m_env.createWindow(win_name, 100, 0, m_env.get_win_width(),
@@ -28,30 +71,21 @@ void Game::init() {
   m_text_renderer = agl::getTextRenderer("Fonts/neuropol.ttf", 30);
   m_text_big = agl::getTextRenderer("Fonts/neuropol.ttf", 72);
 
-  m_easter_egg = m_gameID == "Truman";
+  // first frame: the splash screen, while the rest is still loading
+  m_splash_tex = agl::getTexture(splash_tex);
+  drawSplash();
 
+  m_floor = elements::get_floor(floor_tex);
+  m_sky = elements::get_sky(sky_tex);
   if (m_easter_egg) {
-    m_floor = elements::get_floor("Texture/truman-texture.jpg");
-    m_sky = elements::get_sky("Texture/truman.jpg");
-    m_splash_tex = m_env.loadTexture("Texture/splash3.jpg");
-    m_final_door = elements::get_door("Mesh/porta.obj", "Texture/wop4.jpg");
-
-    m_ssh = elements::get_spaceship("Texture/wood1.jpg", "Mesh/boat.obj",
-                                    m_flappy3D);
-
-  } else {
-    m_floor = elements::get_floor("Texture/tex2.jpg");
-    m_sky = elements::get_sky("Texture/space1.jpg");
-    m_ssh = elements::get_spaceship("Texture/tex5.jpg", "Mesh/Envos.obj",
-                                    m_flappy3D);
-
-    m_splash_tex = m_env.loadTexture("Texture/splash2.jpg");
+    m_final_door = elements::get_door(door_mesh, door_tex);
   }
+  m_ssh = elements::get_spaceship(m_ship_texture, m_ship_mesh, m_flappy3D);
 
   // init spaceship according to the surprise... or not.
   m_ssh->init(m_easter_egg);
 
-  m_menu_tex = m_env.loadTexture("Texture/menu.jpg");
+  m_menu_tex = agl::getTexture("Texture/menu.jpg");
   init_rings();
   init_cubes();
   init_settings();
@@ -215,6 +249,7 @@ void Game::init_cubes() {
     auto coords = coordinateGenerator::randomCoord3D();
     m_cubes.emplace_back(coords.x, coords.y, coords.z, m_flappy3D);
   }
+  m_cube_batch.build(m_cubes);
 }
 
 // set up settings in the vector ready to be printed in the settings screen
@@ -363,43 +398,41 @@ void Game::gameRender() {
   m_env.setupModelLights();
   // update camera
   setupShipCamera();
+  // whatever is out of the camera view is culled from here on
+  m_env.updateFrustum();
 
-  // Render all elements
-  m_floor->render();
-  m_sky->render();
+  // Render all elements: collected first, then drawn sorted by material
+  // (opaque) and back to front (transparent)
+  auto &queue = m_queue;
+  m_floor->submit(queue);
+  m_sky->submit(queue);
 
   // ---FLICKERING PENALTY---
   // if the spaceship hits a cube it will be rendered in a flickered way
   // switching from gouraud to wireframe rendering every 200ms
-  if (m_penalty_time && ((m_penalty_time / 200) % 2 == 1)) {
-    m_ssh->render(true);
-  } else {
-    m_ssh->render();
-  }
+  m_ssh->submit(queue, m_penalty_time && ((m_penalty_time / 200) % 2 == 1));
 
   // rings: render till the first ring that's not triggered yet
   for (size_t i = 0; i < m_num_rings; ++i) {
-    auto &ring = m_rings.at(i);
-    ring.render();
-
-    if (!ring.isTriggered()) {
+    m_rings.at(i).submit(queue);
+    if (!m_rings.at(i).isTriggered()) {
       break;
     }
   }
 
   // render all BadCubes. They'll be an obstacle from the beginning
-  for (auto &cube : m_cubes) {
-    cube.render();
-  }
+  m_cube_batch.submit(queue);
   // apply shadow
   if (m_env.isShadow()) {
-    m_ssh->shadow();
+    m_ssh->shadow(queue);
   }
 
   if (m_cur_ring_index >= m_num_rings && m_easter_egg) {
-    m_final_door->render();
+    m_final_door->submit(queue);
   }
 
+  queue.flush();
+
   // HeadUp Display
   drawHUD();
 
@@ -444,9 +477,9 @@ void Game::restartGame() {
 
   // elements
   // handle 3D flight if activated
-  // retrieve the right type of ship 
-  m_ssh = elements::get_spaceship("Texture/tex5.jpg", "Mesh/Envos.obj",
-                                    m_flappy3D);
+  // retrieve the right type of ship: mesh and texture are still held by the
+  // old ship, so they come straight from the asset registry
+  m_ssh = elements::get_spaceship(m_ship_texture, m_ship_mesh, m_flappy3D);
   m_isFlappyOn = m_flappy3D; // flag to remember the current game is in flappy mode
 
   m_ssh->init(m_easter_egg); // reset
@@ -41,11 +41,22 @@ private:
   std::unique_ptr<agl::AGLTextRenderer> m_text_renderer;
   std::unique_ptr<agl::AGLTextRenderer> m_text_big;
 
+  // retained UI strings: laid out again only when their text changes
+  agl::TextObject m_txt_fps, m_txt_time, m_txt_rings;    // HUD
+  agl::TextObject m_txt_title, m_txt_subtitle;           // splash, game over
+  std::array<agl::TextObject, N_SETTINGS> m_txt_setting; // names
+  std::array<agl::TextObject, N_SETTINGS> m_txt_onoff;   // values
+  agl::TextObject m_txt_restart, m_txt_quit;
+  std::array<agl::TextObject, RANKING_ENTRIES> m_txt_player, m_txt_player_time;
+  std::vector<Entry> m_ranking; // read once at the end of the game
+
   // various elements
   std::unique_ptr<elements::Spaceship> m_ssh;
+  // ship assets of this game mode, reloaded (from the registry) on restart
+  const char *m_ship_texture, *m_ship_mesh;
   elements::Floor *m_floor;
   elements::Sky *m_sky;
-  agl::TexID m_splash_tex, m_menu_tex, m_win_tex, m_lost_tex;
+  agl::TextureHandle m_splash_tex, m_menu_tex;
   std::vector<Setting> m_settings;
 
   // Ring stuff
@@ -55,6 +66,8 @@ private:
 
   // Cube stuff
   std::vector<elements::BadCube> m_cubes;
+  elements::CubeBatch m_cube_batch; // all the cubes, drawn together
+  agl::RenderQueue m_queue; // draw items of the frame, reused every frame
   size_t m_num_cubes;
 
   // Final Door
@@ -73,10 +86,9 @@ private:
   // Draw the HeadUP Display (FPS - Current Time Left - Ring crossed)
   void drawHUD();
   void drawRanking();
-  void drawSettingOnOff(size_t Ycoord, Setting &sg,
-                        bool isSelected = false) const;
-  void drawSettingItem(size_t Xcoord, size_t Yoord, const char *name,
-                       bool isSelected = false) const;
+  void drawSettingOnOff(size_t Ycoord, size_t index, bool isSelected = false);
+  void drawSettingItem(agl::TextObject &text, size_t Xcoord, size_t Yoord,
+                       const char *name, bool isSelected = false);
   void drawSplash();
 
   // game logic helpers
@@ -111,6 +123,7 @@ public:
   std::string m_gameID;
 
   Game(std::string gameID, size_t num_rings); // constructor
+  ~Game();
   void run();
 };
 
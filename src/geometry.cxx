@@ -0,0 +1,124 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/*
+ * Geometry: procedural meshes (torus, floor grid, sky dome...) built once on
+ * the CPU and drawn from GL buffers. See agl.h
+ */
+
+namespace agl {
+
+Geometry::Geometry(GLenum mode)
+    : m_mode(mode), m_vbo(GL_ARRAY_BUFFER), m_ibo(GL_ELEMENT_ARRAY_BUFFER),
+      m_radius(0.0f) {}
+
+void Geometry::clear() {
+  m_vertices.clear();
+  m_indices.clear();
+  m_chunks.clear();
+  m_vbo.release();
+  m_ibo.release();
+  m_radius = 0.0f;
+}
+
+Index Geometry::addVertex(float x, float y, float z, float nx, float ny,
+                          float nz, float u, float v) {
+  m_vertices.push_back(GeoVertex{{x, y, z}, {nx, ny, nz}, {u, v}});
+  m_radius = std::max(m_radius, std::sqrt(x * x + y * y + z * z));
+  return m_vertices.size() - 1;
+}
+
+void Geometry::endChunk(const Point3 &center, float radius) {
+  size_t first =
+      m_chunks.empty() ? 0 : m_chunks.back().first + m_chunks.back().count;
+  m_chunks.push_back(
+      GeoChunk{center, radius, first, m_indices.size() - first});
+}
+
+void Geometry::bind(bool texcoords) {
+  // client side arrays if there are no buffer objects
+  const char *base = reinterpret_cast<const char *>(m_vertices.data());
+  if (Buffer::supported()) {
+    if (!m_ibo.is_uploaded()) {
+      m_vbo.upload(m_vertices.data(), m_vertices.size() * sizeof(GeoVertex));
+      m_ibo.upload(m_indices.data(), m_indices.size() * sizeof(Index));
+    }
+    m_vbo.bind();
+    m_ibo.bind();
+    base = nullptr;
+  }
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(GeoVertex),
+                  base + offsetof(GeoVertex, pos));
+  glNormalPointer(GL_FLOAT, sizeof(GeoVertex),
+                  base + offsetof(GeoVertex, normal));
+  if (texcoords) {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(GeoVertex),
+                      base + offsetof(GeoVertex, uv));
+  }
+}
+
+void Geometry::draw() { draw(0, m_indices.size()); }
+
+void Geometry::draw(size_t first, size_t count) {
+  // offset in the bound index buffer, or pointer to the client side array
+  const GLvoid *indices =
+      Buffer::supported()
+          ? reinterpret_cast<const GLvoid *>(first * sizeof(Index))
+          : m_indices.data() + first;
+  glDrawElements(m_mode, count, GL_UNSIGNED_INT, indices);
+}
+
+void Geometry::drawVisible() {
+  if (m_chunks.empty()) {
+    draw();
+    return;
+  }
+
+  auto &env = get_env();
+  size_t first = 0, count = 0;
+  for (const auto &chunk : m_chunks) {
+    if (!env.isVisible(chunk.center, chunk.radius)) {
+      continue;
+    }
+    // merge with the previous run if adjacent
+    if (count > 0 && first + count == chunk.first) {
+      count += chunk.count;
+      continue;
+    }
+    if (count > 0) {
+      draw(first, count);
+    }
+    first = chunk.first;
+    count = chunk.count;
+  }
+
+  if (count > 0) {
+    draw(first, count);
+  }
+}
+
+void Geometry::unbind() {
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  if (Buffer::supported()) {
+    m_ibo.unbind();
+    m_vbo.unbind();
+  }
+}
+
+void Geometry::render(bool texcoords) {
+  bind(texcoords);
+  drawVisible();
+  unbind();
+}
+
+} // namespace agl
@@ -0,0 +1,175 @@
+#include "agl.h"
+
+/*
+ * GLState: shadow copy of the fixed-function state used by the game.
+ * Every change goes through here and reaches the driver only if it actually
+ * changes something. See agl.h
+ */
+
+namespace agl {
+
+GLState::GLState() : m_calls(0), m_skipped(0) { invalidate(); }
+
+// forget everything: the next change of each state is always issued.
+// Needed whenever a new context is created
+void GLState::invalidate() {
+  m_caps.clear();
+  m_texgen.clear();
+  m_lights.clear();
+  m_materials.clear();
+  m_texture_valid = m_blend_valid = m_color_valid = false;
+  m_line_width = m_polygon_mode = 0;
+}
+
+// count the call and tell whether it can be skipped
+bool GLState::skip(bool unchanged) {
+  if (unchanged) {
+    m_skipped++;
+  } else {
+    m_calls++;
+  }
+  return unchanged;
+}
+
+void GLState::set(GLenum cap, bool on) {
+  auto it = m_caps.find(cap);
+  if (skip(it != m_caps.end() && it->second == on)) {
+    return;
+  }
+
+  m_caps[cap] = on;
+  if (on) {
+    glEnable(cap);
+  } else {
+    glDisable(cap);
+  }
+}
+
+void GLState::bindTexture(TexID texture) {
+  if (skip(m_texture_valid && m_texture == texture)) {
+    return;
+  }
+
+  m_texture = texture;
+  m_texture_valid = true;
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+// GL binds 0 when the bound texture is deleted
+void GLState::deleteTexture(TexID texture) {
+  if (m_texture_valid && m_texture == texture) {
+    m_texture = 0;
+  }
+  glDeleteTextures(1, &texture);
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst) {
+  if (skip(m_blend_valid && m_blend_src == src && m_blend_dst == dst)) {
+    return;
+  }
+
+  m_blend_src = src;
+  m_blend_dst = dst;
+  m_blend_valid = true;
+  glBlendFunc(src, dst);
+}
+
+void GLState::texGen(GLenum coord, GLint mode) {
+  auto it = m_texgen.find(coord);
+  if (skip(it != m_texgen.end() && it->second == mode)) {
+    return;
+  }
+
+  m_texgen[coord] = mode;
+  glTexGeni(coord, GL_TEXTURE_GEN_MODE, mode);
+}
+
+void GLState::color(const Color &c) {
+  if (skip(m_color_valid && m_color.r == c.r && m_color.g == c.g &&
+           m_color.b == c.b && m_color.a == c.a)) {
+    return;
+  }
+
+  m_color = c;
+  m_color_valid = true;
+  glColor4f(c.r, c.g, c.b, c.a);
+}
+
+void GLState::lineWidth(float width) {
+  if (skip(m_line_width == width)) {
+    return;
+  }
+
+  m_line_width = width;
+  glLineWidth(width);
+}
+
+void GLState::polygonMode(GLenum mode) {
+  if (skip(m_polygon_mode == mode)) {
+    return;
+  }
+
+  m_polygon_mode = mode;
+  glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+// light and material colours have 4 components, everything else is a scalar.
+// Positions and directions are transformed by the current modelview when
+// they are set: the same values may mean something else, never skip them
+void GLState::lightv(GLenum light, GLenum pname, const float *params) {
+  if (pname == GL_POSITION || pname == GL_SPOT_DIRECTION) {
+    m_calls++;
+    glLightfv(light, pname, params);
+    return;
+  }
+
+  Params4 value = {{params[0], params[1], params[2], params[3]}};
+  auto key = std::make_pair(light, pname);
+  auto it = m_lights.find(key);
+  if (skip(it != m_lights.end() && it->second == value)) {
+    return;
+  }
+
+  m_lights[key] = value;
+  glLightfv(light, pname, params);
+}
+
+void GLState::lightf(GLenum light, GLenum pname, float param) {
+  Params4 value = {{param, 0, 0, 0}};
+  auto key = std::make_pair(light, pname);
+  auto it = m_lights.find(key);
+  if (skip(it != m_lights.end() && it->second == value)) {
+    return;
+  }
+
+  m_lights[key] = value;
+  glLightf(light, pname, param);
+}
+
+void GLState::materialv(GLenum face, GLenum pname, const float *params) {
+  Params4 value = {{params[0], params[1], params[2], params[3]}};
+  auto key = std::make_pair(face, pname);
+  auto it = m_materials.find(key);
+  if (skip(it != m_materials.end() && it->second == value)) {
+    return;
+  }
+
+  m_materials[key] = value;
+  glMaterialfv(face, pname, params);
+}
+
+void GLState::materialf(GLenum face, GLenum pname, float param) {
+  Params4 value = {{param, 0, 0, 0}};
+  auto key = std::make_pair(face, pname);
+  auto it = m_materials.find(key);
+  if (skip(it != m_materials.end() && it->second == value)) {
+    return;
+  }
+
+  m_materials[key] = value;
+  glMaterialf(face, pname, param);
+}
+
+void GLState::resetCounters() { m_calls = m_skipped = 0; }
+
+} // namespace agl
@@ -15,6 +15,9 @@ const char *level_to_str(Level lv) {
   case Level::INFO:
     return "I";
 
+  case Level::WARNING:
+    return "W";
+
   case Level::ERROR:
     return "E";
 
@@ -46,13 +49,15 @@ void Logger::vprint(const char *tag, Level lv, const char *fmt,
     tag = "<no tag>";
   }
 
-  m_os << level_to_str(lv) << ": " << tag << ": ";
-
   char *str = nullptr;
   // let's just call vasprintf
   vasprintf(&str, fmt, l);
 
-  m_os << str << std::endl;
+  {
+    // one whole line at a time
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_os << level_to_str(lv) << ": " << tag << ": " << str << std::endl;
+  }
 
   // free the pointer dude
   std::free(str);
@@ -86,6 +91,16 @@ void Logger::i(const char *tag, const char *fmt, ...) {
   va_end(ap);
 }
 
+void Logger::w(const char *tag, const char *fmt, ...) {
+  std::va_list ap;
+  va_start(ap, fmt);
+
+  Level lv = Level::WARNING;
+  vprint(tag, lv, fmt, ap);
+
+  va_end(ap);
+}
+
 void Logger::e(const char *tag, const char *fmt, ...) {
   std::va_list ap;
   va_start(ap, fmt);
@@ -185,6 +200,16 @@ void i(const char *tag, const char *fmt, ...) {
   va_end(ap);
 }
 
+void w(const char *tag, const char *fmt, ...) {
+  std::va_list ap;
+  va_start(ap, fmt);
+
+  Level lv = Level::WARNING;
+  s_logger.vprint(tag, lv, fmt, ap);
+
+  va_end(ap);
+}
+
 void e(const char *tag, const char *fmt, ...) {
   std::va_list ap;
   va_start(ap, fmt);
@@ -4,10 +4,11 @@
 #include "types.h"
 #include <cstdarg>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
 // pretty simple logging utility with printf-like formatting
-// Levels are: INFO, ERROR, PANIC, defined in types.h
+// Levels are: INFO, WARNING, ERROR, PANIC, defined in types.h
 
 // log is already in use by std Library
 namespace lg {
@@ -16,6 +17,7 @@ class Logger {
 private:
   std::ostream &m_os;
   Level m_level;
+  std::mutex m_mutex; // assets are loaded (and logged) by worker threads too
 
 public:
   // singleton function must be friend
@@ -30,6 +32,7 @@ public:
   void vpanic(const char *tag, const char *fmt, std::va_list l);
 
   void i(const char *tag, const char *fmt, ...);
+  void w(const char *tag, const char *fmt, ...);
   void e(const char *tag, const char *fmt, ...);
   void panic(const char *tag, const char *fmt, ...);
 
@@ -52,6 +55,7 @@ void print(const char *tag, Level lv, const char *fmt, ...);
 void vpanic(const char *tag, Level lv, const char *fmt, std::va_list l);
 
 void i(const char *tag, const char *fmt, ...);
+void w(const char *tag, const char *fmt, ...);
 void e(const char *tag, const char *fmt, ...);
 // Panic: GET OUTTA HERE
 void panic(const char *tag, const char *fmt, ...);
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstdlib>
 
 #include "agl.h"
 #include "elements.h"
@@ -12,12 +13,54 @@
 
 int main(int argc, char **argv) {
 
-  if (argc != 2) {
-    lg::e(__func__, "Usage: ./game <player_name>");
+  static const char *USAGE = "Usage: ./game <player_name> [--glsl] "
+                             "[--vsync|--adaptive|--uncapped] [--fps=<cap>] "
+                             "[--shadow-map=<size>]";
+  if (argc < 2) {
+    lg::e(__func__, "%s", USAGE);
     return EXIT_FAILURE;
   }
   lg::set_level(lg::Level::INFO);
 
+  // rendering options, before the window gets created
+  auto &env = agl::get_env();
+  for (int i = 2; i < argc; ++i) {
+    std::string opt(argv[i]);
+    if (opt == "--glsl") {
+      // draw the scene with shaders instead of fixed-function GL
+      env.set_shaders(true);
+    } else if (opt == "--vsync") {
+      env.pacer().set_mode(agl::SwapMode::VSYNC);
+    } else if (opt == "--adaptive") {
+      env.pacer().set_mode(agl::SwapMode::ADAPTIVE);
+    } else if (opt == "--uncapped") {
+      env.pacer().set_mode(agl::SwapMode::UNCAPPED);
+    } else if (opt.compare(0, 6, "--fps=") == 0) {
+      const char *arg = opt.c_str() + 6;
+      char *end = nullptr;
+      double fps = std::strtod(arg, &end);
+      if (end == arg || *end != '\0' || !std::isfinite(fps) || fps <= 0.0) {
+        lg::e(__func__, "%s", USAGE);
+        return EXIT_FAILURE;
+      }
+      env.pacer().set_fps_cap(fps);
+    } else if (opt.compare(0, 13, "--shadow-map=") == 0) {
+      // silhouette texture instead of the footprint, size x size pixels
+      const char *arg = opt.c_str() + 13;
+      char *end = nullptr;
+      long size = std::strtol(arg, &end, 10);
+      if (end == arg || *end != '\0' || size <= 0 ||
+          size_t(size) > agl::SHADOW_MAP_MAX_SIZE) {
+        lg::e(__func__, "%s", USAGE);
+        return EXIT_FAILURE;
+      }
+      env.set_shadow_map_size(size);
+    } else {
+      lg::e(__func__, "%s", USAGE);
+      return EXIT_FAILURE;
+    }
+  }
+
   std::string name(argv[1]);
   size_t num_rings = 4;
   game::Game game(name, num_rings);
@@ -1,410 +1,669 @@
 #include "agl.h"
 
 #include <algorithm>
-#include <fstream>
-#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_set>
 
-#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 /*
  * Class implementing a Mesh. See agl.h
  */
 
 namespace agl {
-// Face constructor, compute the normal of the face too
-Face::Face(Vertex *v1, Vertex *v2, Vertex *v3) : verts{v1, v2, v3} {
-  computeNormal();
+
+Mesh::Mesh()
+    : m_vbo_positions(GL_ARRAY_BUFFER), m_vbo_normals(GL_ARRAY_BUFFER),
+      m_ibo_faces(GL_ELEMENT_ARRAY_BUFFER),
+      m_ibo_edges(GL_ELEMENT_ARRAY_BUFFER) {}
+
+namespace {
+// below this number of faces per thread, spawning workers isn't worth it
+static const size_t MIN_FACES_PER_THREAD = 1 << 15;
+
+// split [0, n) in n_threads contiguous slices and call fn(begin, end, slice)
+// on each one of them. The first slice runs on the calling thread.
+template <typename Fn> void parallelFor(size_t n, size_t n_threads, Fn fn) {
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < n_threads; ++t) {
+    workers.emplace_back(fn, n * t / n_threads, n * (t + 1) / n_threads, t);
+  }
+  fn(0, n / n_threads, 0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// normalize a 3D vector in place: same operations as Point3::normalize(),
+// but inlined
+inline void normalize3(float *v) {
+  float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  v[0] /= len;
+  v[1] /= len;
+  v[2] /= len;
 }
 
-Mesh::Mesh() {}
+// face normal, bit-for-bit equal to Mesh::faceNormal()
+inline void computeFaceNormal(const Point3 &p0, const Point3 &p1,
+                              const Point3 &p2, float *n) {
+#if defined(__SSE__)
+  // edges and cross product on 4-wide registers (last lane unused)
+  const __m128 a = _mm_setr_ps(p0.x, p0.y, p0.z, 0.0f);
+  const __m128 e1 = _mm_sub_ps(_mm_setr_ps(p1.x, p1.y, p1.z, 0.0f), a);
+  const __m128 e2 = _mm_sub_ps(_mm_setr_ps(p2.x, p2.y, p2.z, 0.0f), a);
+
+  // e1 x e2 = e1 * e2.yzx - e1.yzx * e2, then rotated back to xyz
+  const __m128 e1_yzx = _mm_shuffle_ps(e1, e1, _MM_SHUFFLE(3, 0, 2, 1));
+  const __m128 e2_yzx = _mm_shuffle_ps(e2, e2, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 c = _mm_sub_ps(_mm_mul_ps(e1, e2_yzx), _mm_mul_ps(e1_yzx, e2));
+  c = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+
+  float out[4];
+  _mm_storeu_ps(out, c);
+  n[0] = out[0];
+  n[1] = out[1];
+  n[2] = out[2];
+#else
+  const float e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+  const float e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+#endif
+
+  normalize3(n);
+  // the faces are clockwise
+  n[0] = -n[0];
+  n[1] = -n[1];
+  n[2] = -n[2];
+}
+} // namespace
 
 // Computo normali per vertice
 // (come media rinormalizzata delle normali delle facce adjacenti)
-void Mesh::computeNormalsPerVertex() {
-  // uso solo le strutture di navigazione FV (da Faccia a Vertice)!
-
-  // fase uno: ciclo sui vertici, azzero tutte le normali
-  for (auto &vertex : m_verts) {
-    vertex.normal = Normal3();
-  }
+// e bounding box, in un'unica passata data-parallel.
+// Big meshes are split among threads: each thread accumulates the face
+// normals of its slice of faces in its own partial buffer, then the partial
+// buffers are summed, renormalized and swept for the AABB, again in parallel
+// on slices of vertices.
+void Mesh::computeNormalsAndBoundingBox() {
+  const size_t nv = m_positions.size();
+  const size_t nf = m_faces.size();
+  const size_t n_threads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          nf / MIN_FACES_PER_THREAD));
+
+  // fase uno: azzero tutte le normali.
+  // The first thread accumulates directly into m_normals
+  m_normals.assign(nv, Normal3());
+  std::vector<std::vector<Normal3>> partials(n_threads - 1);
 
   // fase due: ciclo sulle facce: accumulo le normali di F nei 3 V
   // corrispondenti
-  for (auto &face : m_faces) {
-    for (auto vertex : face.verts) {
-      vertex->normal += face.normal;
+  const Point3 *positions = m_positions.data();
+  const Face *faces = m_faces.data();
+  parallelFor(nf, n_threads, [&](size_t begin, size_t end, size_t t) {
+    Normal3 *acc = m_normals.data();
+    if (t > 0) {
+      partials[t - 1].assign(nv, Normal3());
+      acc = partials[t - 1].data();
     }
-    /*
-    f[i].v[0]->n = f[i].v[0]->n + f[i].n;
-    f[i].v[1]->n = f[i].v[1]->n + f[i].n;
-    f[i].v[2]->n = f[i].v[2]->n + f[i].n;
-    */
-  }
+
+    for (size_t i = begin; i < end; ++i) {
+      const auto &face = faces[i];
+      float n[3];
+      computeFaceNormal(positions[face.verts[0]], positions[face.verts[1]],
+                        positions[face.verts[2]], n);
+      for (auto index : face.verts) {
+        acc[index].x += n[0];
+        acc[index].y += n[1];
+        acc[index].z += n[2];
+      }
+    }
+  });
 
   // fase tre: ciclo sui vertici e rinormalizzo:
   // la normale media rinormalizzata e' uguale alla somma delle normnali,
-  // calcolata nel ciclo precedente, ma rinormalizzata
-  for (auto &vertex : m_verts) {
-    vertex.normal = vertex.normal.normalize();
+  // calcolata nel ciclo precedente, ma rinormalizzata.
+  // The same sweep finds min and max coordinates for the bounding box
+  std::vector<Point3> mins(n_threads, Point3(INFINITY, INFINITY, INFINITY));
+  std::vector<Point3> maxs(n_threads, Point3(-INFINITY, -INFINITY, -INFINITY));
+  parallelFor(nv, n_threads, [&](size_t begin, size_t end, size_t t) {
+    Point3 lo = mins[t], hi = maxs[t];
+
+    for (size_t i = begin; i < end; ++i) {
+      float *n = &m_normals[i].x;
+      for (const auto &partial : partials) {
+        n[0] += partial[i].x;
+        n[1] += partial[i].y;
+        n[2] += partial[i].z;
+      }
+      normalize3(n);
+
+      const auto &p = positions[i];
+      lo.x = std::min(lo.x, p.x);
+      lo.y = std::min(lo.y, p.y);
+      lo.z = std::min(lo.z, p.z);
+      hi.x = std::max(hi.x, p.x);
+      hi.y = std::max(hi.y, p.y);
+      hi.z = std::max(hi.z, p.z);
+    }
+
+    mins[t] = lo;
+    maxs[t] = hi;
+  });
+
+  bbmin = mins[0];
+  bbmax = maxs[0];
+  for (size_t t = 1; t < n_threads; ++t) {
+    bbmin.x = std::min(bbmin.x, mins[t].x);
+    bbmin.y = std::min(bbmin.y, mins[t].y);
+    bbmin.z = std::min(bbmin.z, mins[t].z);
+    bbmax.x = std::max(bbmax.x, maxs[t].x);
+    bbmax.y = std::max(bbmax.y, maxs[t].y);
+    bbmax.z = std::max(bbmax.z, maxs[t].z);
   }
 }
 
-// renderizzo la mesh in wireframe
+// renderizzo la mesh in wireframe: each edge is drawn once, as a GL_LINES
+// batch, using the edge table built at load time
 void Mesh::renderWire() {
-  glLineWidth(1.0);
-  // (nota: ogni edge viene disegnato due volte.
-  // sarebbe meglio avere ed usare la struttura edge)
-  glBegin(GL_LINE_LOOP);
-  for (auto &face : m_faces) {
-    face.normal.render();
-    for (auto vertex : face.verts) {
-      // render as vertex, don't send the normal
-      vertex->render(false);
+  agl::get_env().lineWidth(1.0);
+
+  if (Buffer::supported()) {
+    bindVertexArrays();
+    m_ibo_edges.bind();
+    glDrawElements(GL_LINES, 2 * m_edges.size(), GL_UNSIGNED_INT, nullptr);
+    m_ibo_edges.unbind();
+    unbindVertexArrays();
+    return;
+  }
+
+  glBegin(GL_LINES);
+  for (const auto &edge : m_edges) {
+    for (auto index : edge.v) {
+      glNormal3fv(&m_normals[index].x);
+      glVertex3fv(&m_positions[index].x);
     }
   }
   glEnd();
-
-  /*  {
-      glBegin(GL_LINE_LOOP);
-      f[i].n.getAsNormal();
-      (f[i].v[0])->p.getAsVertex();
-      (f[i].v[1])->p.getAsVertex();
-      (f[i].v[2])->p.getAsVertex();
-      glEnd();
-    }*/
 }
 
 // Render usando la normale per faccia (FLAT SHADING)
 void Mesh::renderFlat(bool wireframe_on) { render(wireframe_on, false); }
 
+// Render usando la normale per vertice (GOURAUD SHADING)
 void Mesh::renderGouraud(bool wireframe_on) { render(wireframe_on, true); }
 
-// Render usando la normale per vertice (GOURAUD SHADING)
 void Mesh::render(bool wireframe_on, bool goraud_shading) {
   if (wireframe_on) {
-    glDisable(GL_TEXTURE_2D);
-    glColor3f(.5, .5, .5);
+    auto &env = agl::get_env();
+    env.gl().disable(GL_TEXTURE_2D);
+    env.setColor(Color(.5, .5, .5));
     renderWire();
-    glColor3f(1, 1, 1);
+    env.setColor(WHITE);
   }
 
-  glBegin(GL_TRIANGLES);
+  // far away meshes are drawn with one of their simplified levels
+  size_t level = selectLevel();
 
-  if (goraud_shading) {
-    // mandiamo tutti i triangoli a schermo
-    bool send_normals = goraud_shading;
+  // per-vertex normals are already on the GPU: one draw call is enough.
+  // Flat shading needs a normal per face, that goes through immediate mode
+  if (goraud_shading && Buffer::supported()) {
+    renderBuffers(level);
+    return;
+  }
 
-    for (const auto &face : m_faces) {
-      // If using flat shading
-      if (!send_normals) {
-        face.normal.render();
-      }
+  // fallback: mandiamo tutti i triangoli a schermo, uno per uno
+  glBegin(GL_TRIANGLES);
+  for (const auto &face : levelFaces(level)) {
+    // If using flat shading
+    if (!goraud_shading) {
+      faceNormal(face).render();
+    }
 
-      for (auto vert : face.verts) {
-        vert->render(send_normals);
+    for (auto index : face.verts) {
+      if (goraud_shading) {
+        glNormal3fv(&m_normals[index].x);
       }
+      glVertex3fv(&m_positions[index].x);
     }
   }
-  /*
-        for (int i = 0; i < f.size(); i++) {
-          (f[i].v[0])->n.getAsNormal();
-          (f[i].v[0])->p.getAsVertex();
+  glEnd();
+}
 
-          (f[i].v[1])->n.getAsNormal();
-          (f[i].v[1])->p.getAsVertex();
+// copy positions, normals, faces and edges into GL buffer objects.
+// The arrays are already laid out as GL expects them: no conversion needed
+void Mesh::upload() {
+  m_vbo_positions.upload(m_positions.data(),
+                         m_positions.size() * sizeof(Point3));
+  m_vbo_normals.upload(m_normals.data(), m_normals.size() * sizeof(Normal3));
+  m_ibo_faces.upload(m_faces.data(), m_faces.size() * sizeof(Face));
+  m_ibo_edges.upload(m_edges.data(), m_edges.size() * sizeof(Edge));
+  for (auto &level : m_levels) {
+    level.ibo.upload(level.faces.data(), level.faces.size() * sizeof(Face));
+  }
+}
 
-          (f[i].v[2])->n.getAsNormal();
-          (f[i].v[2])->p.getAsVertex();
-        }
-    }
-      else {
-        //flat shading
-        for (int i = 0; i < f.size(); i++) {
-          f[i].n.getAsNormal(); // flat shading
+void Mesh::bindVertexArrays() {
+  if (!m_ibo_faces.is_uploaded()) {
+    upload();
+  }
 
-          (f[i].v[0])->p.getAsVertex();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
 
-          (f[i].v[1])->p.getAsVertex();
+  m_vbo_positions.bind();
+  glVertexPointer(3, GL_FLOAT, 0, nullptr);
+  m_vbo_normals.bind();
+  glNormalPointer(GL_FLOAT, 0, nullptr);
+  m_vbo_normals.unbind();
+}
 
-          (f[i].v[2])->p.getAsVertex();
-        }
+void Mesh::unbindVertexArrays() {
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void Mesh::renderBuffers(size_t level) {
+  const Buffer &ibo = level == 0 ? m_ibo_faces : m_levels[level - 1].ibo;
+
+  bindVertexArrays();
+  ibo.bind();
+  glDrawElements(GL_TRIANGLES, 3 * levelFaces(level).size(), GL_UNSIGNED_INT,
+                 nullptr);
+  ibo.unbind();
+  unbindVertexArrays();
+}
+
+// each edge is shared by (usually) two faces: keep only the first one met,
+// identified by its sorted pair of vertex indices
+void Mesh::computeEdges() {
+  std::unordered_set<uint64_t> seen;
+  seen.reserve(m_faces.size() * 2);
+
+  m_edges.clear();
+  m_edges.reserve(m_faces.size() * 3 / 2);
+  for (const auto &face : m_faces) {
+    for (size_t k = 0; k < 3; ++k) {
+      Index a = face.verts[k];
+      Index b = face.verts[(k + 1) % 3];
+      uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+      if (seen.insert(key).second) {
+        m_edges.push_back(Edge{{a, b}});
+      }
     }
-  */
-  glEnd();
+  }
 }
 
-// trova l'AXIS ALIGNED BOUNDIG BOX
-void Mesh::computeBoundingBox() {
-  // basta trovare la min x, y, e z, e la max x, y, e z di tutti i vertici
-  // (nota: non e' necessario usare le facce: perche?)
-  // init var to worse value
-  float min_x, min_y, min_z = INFINITY;
-  float max_x, max_y, max_z = -INFINITY;
+// init vertex normals and bounding box
+void Mesh::init() { computeNormalsAndBoundingBox(); }
 
-  // find maximum and minimum among vertices
-  for (const auto &vertex : m_verts) {
-    min_x = std::min(min_x, vertex.point.x);
-    min_y = std::min(min_y, vertex.point.y);
-    min_z = std::min(min_z, vertex.point.z);
+// Andrew's monotone chain on the (x, z) projection of the vertices
+const std::vector<Point2> &Mesh::footprint() {
+  if (!m_footprint.empty() || m_positions.empty()) {
+    return m_footprint;
+  }
 
-    max_x = std::max(max_x, vertex.point.x);
-    max_y = std::max(max_y, vertex.point.y);
-    max_z = std::max(max_z, vertex.point.z);
+  std::vector<Point2> points(m_positions.size());
+  for (size_t i = 0; i < m_positions.size(); ++i) {
+    points[i] = Point2{m_positions[i].x, m_positions[i].z};
+  }
+  std::sort(points.begin(), points.end(),
+            [](const Point2 &a, const Point2 &b) {
+              return a.x < b.x || (a.x == b.x && a.z < b.z);
+            });
+
+  // > 0 if o, a, b turn counterclockwise
+  auto cross = [](const Point2 &o, const Point2 &a, const Point2 &b) {
+    return (a.x - o.x) * (b.z - o.z) - (a.z - o.z) * (b.x - o.x);
+  };
+
+  std::vector<Point2> hull(2 * points.size());
+  size_t k = 0;
+  // lower hull, then upper hull
+  for (size_t i = 0; i < points.size(); ++i) {
+    while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+      k--;
+    }
+    hull[k++] = points[i];
   }
+  for (size_t i = points.size() - 1, lower = k + 1; i > 0; --i) {
+    while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) {
+      k--;
+    }
+    hull[k++] = points[i - 1];
+  }
+  // the last point is the first one again
+  hull.resize(k > 1 ? k - 1 : k);
 
-  bbmin = Point3(min_x, min_y, min_z);
-  bbmax = Point3(max_x, max_y, max_z);
+  lg::i(__func__, "Mesh footprint: %zu vertices out of %zu", hull.size(),
+        m_positions.size());
+  m_footprint.swap(hull);
+  return m_footprint;
 }
 
-// Point3 Mesh::center() { return (bbmin + bbmax) / 2.0; };
-
-// init vertex normals and bounding box
-void Mesh::init() {
-  computeNormalsPerVertex();
-  computeBoundingBox();
+// farthest corner of the bounding box from the origin
+float Mesh::radius() const {
+  Point3 corner(std::max(std::fabs(bbmin.x), std::fabs(bbmax.x)),
+                std::max(std::fabs(bbmin.y), std::fabs(bbmax.y)),
+                std::max(std::fabs(bbmin.z), std::fabs(bbmax.z)));
+  return corner.modulo();
 }
 
 //   carica la mesh da un file in formato Obj
 //   Nota: nel file, possono essere presenti sia quads che tris
 //   ma nella rappresentazione interna (classe Mesh) abbiamo solo tris.
 
+namespace {
+// files smaller than this are parsed on the calling thread: spawning workers
+// would cost more than the parsing itself
+static const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+
+// exact powers of ten for the float fast path (all representable in a float)
+static const float POW10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                              1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+// partial result of the parsing of a slice of the file.
+// Faces are stored as 0-based vertex indices, so that chunks parsed on
+// different threads can be merged without any fix-up.
+struct ObjChunk {
+  std::vector<Point3> verts;
+  std::vector<int> tris; // 3 indices per triangle
+  const char *begin, *end;
+};
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char *skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+inline const char *skipLine(const char *p, const char *end) {
+  const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+  return nl ? nl + 1 : end;
+}
+
+// hand-written integer scanner. Returns false if there is no integer at p
+inline bool scanInt(const char *&p, const char *end, int &out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    ++p;
+  }
+  if (p >= end || !isDigit(*p)) {
+    return false;
+  }
+
+  int val = 0;
+  while (p < end && isDigit(*p)) {
+    val = val * 10 + (*p++ - '0');
+  }
+  out = neg ? -val : val;
+  return true;
+}
+
+// hand-written float scanner.
+// Numbers with few significant digits (the usual case in an OBJ) are converted
+// with a single correctly rounded float operation, everything else goes
+// through strtof: either way the result is the same as fscanf("%f").
+inline bool scanFloat(const char *&p, const char *end, float &out) {
+  const char *start = p;
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0, exp10 = 0;
+  bool any = false;
+  while (p < end && isDigit(*p)) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      ++exp10;
+    }
+    any = true;
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && isDigit(*p)) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        --exp10;
+      }
+      any = true;
+      ++p;
+    }
+  }
+  if (!any) {
+    p = start;
+    return false;
+  }
+
+  int exp_val = 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *e = p + 1;
+    if (scanInt(e, end, exp_val)) {
+      p = e;
+    }
+  }
+  exp10 += exp_val;
+
+  if (mantissa <= (1 << 24) && exp10 >= -10 && exp10 <= 10) {
+    float val = static_cast<float>(mantissa);
+    val = exp10 < 0 ? val / POW10[-exp10] : val * POW10[exp10];
+    out = neg ? -val : val;
+    return true;
+  }
+
+  // slow path: the mapping is not NUL-terminated, copy the token first
+  char buf[64];
+  size_t len = std::min<size_t>(p - start, sizeof(buf) - 1);
+  std::memcpy(buf, start, len);
+  buf[len] = '\0';
+  out = std::strtof(buf, nullptr);
+  return true;
+}
+
+// parse the lines in [chunk.begin, chunk.end).
+// Only vertices ("v") and faces ("f") are read, everything else is skipped.
+// Faces are triangulated as a fan, with the same winding as the old loader.
+void parseObjChunk(ObjChunk &chunk) {
+  const char *p = chunk.begin;
+  const char *end = chunk.end;
+
+  // rough estimate of the number of lines, avoids most of the reallocations
+  chunk.verts.reserve((end - p) / 64);
+  chunk.tris.reserve((end - p) / 16);
+
+  while (p < end) {
+    p = skipBlanks(p, end);
+    if (p + 1 < end && isBlank(p[1])) {
+      if (p[0] == 'v') {
+        // vertex
+        float coords[3] = {0.0f, 0.0f, 0.0f};
+        p += 2;
+        for (auto &c : coords) {
+          p = skipBlanks(p, end);
+          scanFloat(p, end, c);
+        }
+        chunk.verts.emplace_back(coords[0], coords[1], coords[2]);
+      } else if (p[0] == 'f') {
+        // face: can be one of %d, %d//%d, %d/%d, %d/%d/%d
+        // only the vertex index is used
+        int va = 0, vb = 0, vc = 0, n = 0;
+        p += 2;
+        for (;;) {
+          p = skipBlanks(p, end);
+          int idx;
+          if (!scanInt(p, end, idx)) {
+            break;
+          }
+          // skip texture and normal indices
+          while (p < end && !isBlank(*p) && *p != '\n') {
+            ++p;
+          }
+
+          if (n == 0) {
+            va = idx - 1;
+          } else if (n == 1) {
+            vb = idx - 1;
+          } else {
+            vc = idx - 1;
+            chunk.tris.push_back(va);
+            chunk.tris.push_back(vc);
+            chunk.tris.push_back(vb);
+            vb = vc;
+          }
+          ++n;
+        }
+      }
+    }
+    p = skipLine(p, end);
+  }
+}
+} // namespace
+
 // Friend class, must be used instead of the constructor
-std::unique_ptr<Mesh> loadMesh(const char *filename) {
+std::unique_ptr<Mesh> loadMesh(const char *filename, bool build_lod) {
   static const auto TAG = __func__;
 
   lg::i(TAG, "Loading mesh from file %s", filename);
 
   std::unique_ptr<Mesh> ret(new Mesh());
 
-  FILE *file = fopen(filename, "rt"); // apriamo il file in lettura
-  if (!file) {
+  // an up-to-date binary sidecar skips both parsing and normals computation
+  if (ret->loadCache(filename)) {
+    // an older sidecar may come from a load without LOD chain
+    if (build_lod && ret->m_levels.empty()) {
+      ret->buildLevels();
+      ret->saveCache(filename);
+    }
+    return ret;
+  }
+
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
     // whenever I've spare time, an exception class must be added
     lg::e(TAG, "Cannot load mesh from %s", filename);
     exit(EXIT_FAILURE);
   }
 
-  // make a first pass through the file to get a count of the number
-  // of vertices, normals, texcoords & triangles
-  char buf[128];
-  int nv, nf, nt;
-  float x, y, z;
-  int va, vb, vc, vd;
-  int na, nb, nc, nd;
-  int ta, tb, tc, td;
-
-  nv = 0;
-  nf = 0;
-  nt = 0;
-  while (std::fscanf(file, "%s", buf) != EOF) {
-    switch (buf[0]) {
-    case '#': // comment
-      // eat up rest of line
-      std::fgets(buf, sizeof(buf), file);
-      break;
-    case 'v': // v, vn, vt
-      switch (buf[1]) {
-      case '\0': // vertex
-        // eat up rest of line
-        std::fgets(buf, sizeof(buf), file);
-        nv++;
-        break;
-      default:
-        break;
-      }
-      break;
-    case 'f': // face
-      std::fscanf(file, "%s", buf);
-      // can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d
-      if (std::strstr(buf, "//")) {
-        // v//n
-        std::sscanf(buf, "%d//%d", &va, &na);
-        std::fscanf(file, "%d//%d", &vb, &nb);
-        std::fscanf(file, "%d//%d", &vc, &nc);
-        nf++;
-        nt++;
-        while (std::fscanf(file, "%d//%d", &vd, &nd) > 0) {
-          nt++;
-        }
-      } else if (std::sscanf(buf, "%d/%d/%d", &va, &ta, &na) == 3) {
-        // v/t/n
-        std::fscanf(file, "%d/%d/%d", &vb, &tb, &nb);
-        std::fscanf(file, "%d/%d/%d", &vc, &tc, &nc);
-        nf++;
-        nt++;
-        while (std::fscanf(file, "%d/%d/%d", &vd, &td, &nd) > 0) {
-          nt++;
-        }
-      } else if (std::sscanf(buf, "%d/%d", &va, &ta) == 2) {
-        // v/t
-        std::fscanf(file, "%d/%d", &vb, &tb);
-        std::fscanf(file, "%d/%d", &vc, &tc);
-        nf++;
-        nt++;
-        while (std::fscanf(file, "%d/%d", &vd, &td) > 0) {
-          nt++;
-        }
-      } else {
-        // v
-        std::fscanf(file, "%d", &va);
-        std::fscanf(file, "%d", &vb);
-        nf++;
-        nt++;
-        while (std::fscanf(file, "%d", &vc) > 0) {
-          nt++;
-        }
-      }
-      break;
-
-    default:
-      // eat up rest of line
-      std::fgets(buf, sizeof(buf), file);
-      break;
+  // map the whole file: the parser scans it in place, in a single pass
+  size_t size = st.st_size;
+  const char *data = nullptr;
+  if (size > 0) {
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      lg::e(TAG, "Cannot map mesh file %s", filename);
+      exit(EXIT_FAILURE);
     }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(addr);
+  }
+  close(fd);
+
+  // split big files in line-aligned chunks, one per thread
+  size_t n_chunks = std::max<size_t>(1, size / OBJ_MIN_CHUNK_SIZE);
+  n_chunks = std::min<size_t>(
+      n_chunks, std::max(1U, std::thread::hardware_concurrency()));
+
+  std::vector<ObjChunk> chunks(n_chunks);
+  const char *cur = data;
+  for (size_t i = 0; i < n_chunks; ++i) {
+    chunks[i].begin = cur;
+    if (i + 1 < n_chunks) {
+      // move the split point forward to the beginning of the next line
+      cur = skipLine(std::max(cur, data + size * (i + 1) / n_chunks),
+                     data + size);
+    } else {
+      cur = data + size;
+    }
+    chunks[i].end = cur;
   }
 
-  // printf("dopo FirstPass nv=%d nf=%d nt=%d\n",nv,nf,nt);
-
-  // allochiamo spazio per nv vertici
-  ret->m_verts.resize(nv);
-
-  // rewind to beginning of file and read in the data this pass
-  rewind(file);
-
-  // on the second pass through the file, read all the data into the
-  // allocated arrays
-
-  nv = 0;
-  nt = 0;
-  while (std::fscanf(file, "%s", buf) != EOF) {
-    switch (buf[0]) {
-    case '#': // comment
-      // eat up rest of line
-      std::fgets(buf, sizeof(buf), file);
-      break;
-    case 'v': // v, vn, vt
-      switch (buf[1]) {
-      case '\0': // vertex
-        std::fscanf(file, "%f %f %f", &x, &y, &z);
-        ret->m_verts[nv] = Point3(x, y, z);
-        nv++;
-        break;
-      default:
-        break;
-      }
-      break;
-    case 'f': // face
-      std::fscanf(file, "%s", buf);
-      // can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d
-      if (std::strstr(buf, "//")) {
-        // v//n
-        std::sscanf(buf, "%d//%d", &va, &na);
-        std::fscanf(file, "%d//%d", &vb, &nb);
-        std::fscanf(file, "%d//%d", &vc, &nc);
-        va--;
-        vb--;
-        vc--;
-
-        // create on place a new face and save it at the end of the face
-        // vector
-        ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                  &(ret->m_verts[vb]));
-
-        nt++;
-        vb = vc;
-        while (std::fscanf(file, "%d//%d", &vc, &nc) > 0) {
-          vc--;
-          ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                    &(ret->m_verts[vb]));
-
-          nt++;
-          vb = vc;
-        }
-      } else if (std::sscanf(buf, "%d/%d/%d", &va, &ta, &na) == 3) {
-        // v/t/n
-        std::fscanf(file, "%d/%d/%d", &vb, &tb, &nb);
-        std::fscanf(file, "%d/%d/%d", &vc, &tc, &nc);
-        va--;
-        vb--;
-        vc--;
-
-        ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                  &(ret->m_verts[vb]));
-
-        nt++;
-        vb = vc;
-        while (std::fscanf(file, "%d/%d/%d", &vc, &tc, &nc) > 0) {
-          vc--;
-
-          ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                    &(ret->m_verts[vb]));
-
-          nt++;
-          vb = vc;
-        }
-      } else if (std::sscanf(buf, "%d/%d", &va, &ta) == 2) {
-        // v/t
-        std::fscanf(file, "%d/%d", &va, &ta);
-        std::fscanf(file, "%d/%d", &va, &ta);
-        va--;
-        vb--;
-        vc--;
-
-        ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                  &(ret->m_verts[vb]));
-
-        nt++;
-        vb = vc;
-        while (std::fscanf(file, "%d/%d", &vc, &tc) > 0) {
-          vc--;
-
-          ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                    &(ret->m_verts[vb]));
-
-          nt++;
-          vb = vc;
-        }
-      } else {
-        // v
-        std::sscanf(buf, "%d", &va);
-        std::fscanf(file, "%d", &vb);
-        std::fscanf(file, "%d", &vc);
-        va--;
-        vb--;
-        vc--;
-
-        ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                  &(ret->m_verts[vb]));
-
-        nt++;
-        vb = vc;
-        while (std::fscanf(file, "%d", &vc) > 0) {
-          vc--;
-
-          ret->m_faces.emplace_back(&(ret->m_verts[va]), &(ret->m_verts[vc]),
-                                    &(ret->m_verts[vb]));
-
-          nt++;
-          vb = vc;
-        }
-      }
-      break;
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < n_chunks; ++i) {
+    workers.emplace_back(parseObjChunk, std::ref(chunks[i]));
+  }
+  if (data) {
+    parseObjChunk(chunks[0]);
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  if (data) {
+    munmap(const_cast<char *>(data), size);
+  }
+
+  // merge the chunks, in file order
+  size_t nv = 0, nt = 0;
+  for (const auto &chunk : chunks) {
+    nv += chunk.verts.size();
+    nt += chunk.tris.size() / 3;
+  }
 
-    default:
-      // eat up rest of line
-      std::fgets(buf, sizeof(buf), file);
-      break;
+  ret->m_positions.reserve(nv);
+  ret->m_faces.reserve(nt);
+  for (const auto &chunk : chunks) {
+    ret->m_positions.insert(ret->m_positions.end(), chunk.verts.begin(),
+                            chunk.verts.end());
+  }
+
+  size_t n_invalid = 0;
+  for (const auto &chunk : chunks) {
+    for (size_t i = 0; i < chunk.tris.size(); i += 3) {
+      Face face = {{Index(chunk.tris[i]), Index(chunk.tris[i + 1]),
+                    Index(chunk.tris[i + 2])}};
+      // negative indices wrap around, so a single check is enough
+      if (face.verts[0] >= nv || face.verts[1] >= nv || face.verts[2] >= nv) {
+        n_invalid++;
+        continue;
+      }
+      ret->m_faces.push_back(face);
     }
   }
 
-  // printf("dopo SecondPass nv=%d nt=%d\n",nv,nt);
+  if (n_invalid) {
+    lg::e(TAG, "%zu faces of %s refer to missing vertices: skipped", n_invalid,
+          filename);
+  }
 
-  std::fclose(file);
+  ret->optimize();
 
   // compute vertex normals and BB
   ret->init();
-  ret->computeBoundingBox();
+  ret->computeEdges();
+
+  if (build_lod) {
+    ret->buildLevels();
+  }
+
+  ret->saveCache(filename);
 
   return ret;
 }
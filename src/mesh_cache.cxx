@@ -0,0 +1,252 @@
+#include "agl.h"
+
+#include <string>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Binary Mesh cache.
+ * Once a mesh has been parsed and initialized it is dumped next to its
+ * source file as "<mesh_filename>.aglmesh". The next loadMesh() maps the
+ * sidecar and reads everything from it: no text parsing and no normals,
+ * bounding box or edge table computation.
+ *
+ * Layout (native endianness):
+ *   MeshCacheHeader
+ *   n_verts x [float x, y, z]  positions
+ *   n_verts x [float x, y, z]  vertex normals
+ *   n_faces x [uint32 a, b, c] triangle indices
+ *   n_edges x [uint32 a, b]    unique edges
+ *   for each LOD level: level_faces[i] x [uint32 a, b, c]
+ *
+ * The header stores size and mtime of the source file: as soon as the .obj
+ * changes the sidecar is considered stale and rewritten.
+ */
+
+namespace agl {
+
+namespace {
+static const char CACHE_MAGIC[8] = {'A', 'G', 'L', 'M', 'E', 'S', 'H', '\0'};
+static const uint32_t CACHE_VERSION = 6;
+static const char *CACHE_EXT = ".aglmesh";
+
+struct MeshCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t n_verts, n_faces, n_edges;
+  uint32_t n_levels, level_faces[MESH_LOD_LEVELS];
+  uint64_t src_size;
+  int64_t src_mtime_sec, src_mtime_nsec;
+  float bbmin[3], bbmax[3];
+};
+
+static_assert(sizeof(Point3) == 3 * sizeof(float),
+              "Point3 must be tightly packed to be cached");
+static_assert(sizeof(Normal3) == sizeof(Point3),
+              "Normal3 must be tightly packed to be cached");
+static_assert(sizeof(Face) == 3 * sizeof(uint32_t),
+              "Face must be tightly packed to be cached");
+static_assert(sizeof(Edge) == 2 * sizeof(uint32_t),
+              "Edge must be tightly packed to be cached");
+
+// size of the whole cache file for the given header
+inline size_t cacheSize(const MeshCacheHeader &hdr) {
+  size_t size = sizeof(MeshCacheHeader) + 2 * sizeof(Point3) * hdr.n_verts +
+                sizeof(Face) * hdr.n_faces + sizeof(Edge) * hdr.n_edges;
+  for (uint32_t i = 0; i < hdr.n_levels && i < MESH_LOD_LEVELS; ++i) {
+    size += sizeof(Face) * hdr.level_faces[i];
+  }
+  return size;
+}
+
+// fill the source file fields of the header, false if the source is missing
+bool statSource(const char *mesh_filename, MeshCacheHeader &hdr) {
+  struct stat st;
+  if (stat(mesh_filename, &st) < 0) {
+    return false;
+  }
+
+  hdr.src_size = st.st_size;
+  hdr.src_mtime_sec = st.st_mtim.tv_sec;
+  hdr.src_mtime_nsec = st.st_mtim.tv_nsec;
+  return true;
+}
+} // namespace
+
+// map the sidecar and fill the mesh with it.
+// Return false if there's no valid cache for mesh_filename.
+bool Mesh::loadCache(const char *mesh_filename) {
+  static const auto TAG = __func__;
+
+  MeshCacheHeader src;
+  if (!statSource(mesh_filename, src)) {
+    return false;
+  }
+
+  std::string cache_filename = std::string(mesh_filename) + CACHE_EXT;
+  int fd = open(cache_filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(MeshCacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = st.st_size;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  const auto *hdr = static_cast<const MeshCacheHeader *>(addr);
+  bool valid = std::memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+               hdr->version == CACHE_VERSION &&
+               hdr->src_size == src.src_size &&
+               hdr->src_mtime_sec == src.src_mtime_sec &&
+               hdr->src_mtime_nsec == src.src_mtime_nsec &&
+               hdr->n_levels <= MESH_LOD_LEVELS && cacheSize(*hdr) == size;
+
+  if (valid) {
+    lg::i(TAG, "Loading mesh from cache %s", cache_filename.c_str());
+
+    // the sections are laid out one after the other, right after the header,
+    // exactly as the Mesh arrays: each one is a single bulk copy. The arrays
+    // stay owned by the Mesh rather than pointing into the mapping: meshes
+    // are shared through the registry for the whole game, a sidecar without
+    // LOD chain gets one appended and rewritten right away, and the rest of
+    // Mesh only knows std::vector
+    const auto *positions = reinterpret_cast<const Point3 *>(hdr + 1);
+    const auto *normals =
+        reinterpret_cast<const Normal3 *>(positions + hdr->n_verts);
+    const auto *faces = reinterpret_cast<const Face *>(normals + hdr->n_verts);
+    const auto *edges = reinterpret_cast<const Edge *>(faces + hdr->n_faces);
+
+    m_positions.assign(positions, positions + hdr->n_verts);
+    m_normals.assign(normals, normals + hdr->n_verts);
+    m_faces.assign(faces, faces + hdr->n_faces);
+    m_edges.assign(edges, edges + hdr->n_edges);
+
+    const auto *level_faces =
+        reinterpret_cast<const Face *>(edges + hdr->n_edges);
+    m_levels.resize(hdr->n_levels);
+    for (uint32_t i = 0; i < hdr->n_levels; ++i) {
+      m_levels[i].faces.assign(level_faces, level_faces + hdr->level_faces[i]);
+      level_faces += hdr->level_faces[i];
+    }
+
+    for (size_t level = 0; valid && level <= m_levels.size(); ++level) {
+      for (const auto &face : levelFaces(level)) {
+        if (face.verts[0] >= hdr->n_verts || face.verts[1] >= hdr->n_verts ||
+            face.verts[2] >= hdr->n_verts) {
+          lg::e(TAG, "Corrupted mesh cache %s", cache_filename.c_str());
+          valid = false;
+          break;
+        }
+      }
+    }
+
+    for (const auto &edge : m_edges) {
+      if (edge.v[0] >= hdr->n_verts || edge.v[1] >= hdr->n_verts) {
+        lg::e(TAG, "Corrupted mesh cache %s", cache_filename.c_str());
+        valid = false;
+        break;
+      }
+    }
+
+    bbmin = Point3(hdr->bbmin[0], hdr->bbmin[1], hdr->bbmin[2]);
+    bbmax = Point3(hdr->bbmax[0], hdr->bbmax[1], hdr->bbmax[2]);
+  }
+
+  munmap(addr, size);
+
+  if (!valid) {
+    m_positions.clear();
+    m_normals.clear();
+    m_faces.clear();
+    m_edges.clear();
+    m_levels.clear();
+  }
+
+  return valid;
+}
+
+// dump the mesh next to its source file.
+// Failures are not fatal: the mesh will simply be parsed again next time.
+void Mesh::saveCache(const char *mesh_filename) const {
+  static const auto TAG = __func__;
+
+  MeshCacheHeader hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  if (!statSource(mesh_filename, hdr)) {
+    return;
+  }
+
+  std::memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  hdr.version = CACHE_VERSION;
+  hdr.n_verts = m_positions.size();
+  hdr.n_faces = m_faces.size();
+  hdr.n_edges = m_edges.size();
+  hdr.n_levels = m_levels.size();
+  for (size_t i = 0; i < m_levels.size(); ++i) {
+    hdr.level_faces[i] = m_levels[i].faces.size();
+  }
+  hdr.bbmin[0] = bbmin.x;
+  hdr.bbmin[1] = bbmin.y;
+  hdr.bbmin[2] = bbmin.z;
+  hdr.bbmax[0] = bbmax.x;
+  hdr.bbmax[1] = bbmax.y;
+  hdr.bbmax[2] = bbmax.z;
+
+  // write to a temporary file and rename it, so that a concurrent load
+  // never sees a half-written cache. The name is unique: other loader
+  // threads or game instances may be writing the same cache
+  std::string cache_filename = std::string(mesh_filename) + CACHE_EXT;
+  std::string tmp_filename = cache_filename + ".XXXXXX";
+
+  FILE *file = nullptr;
+  int fd = mkstemp(&tmp_filename[0]);
+  if (fd >= 0) {
+    // mkstemp creates it readable by the owner only
+    fchmod(fd, 0644);
+    file = fdopen(fd, "wb");
+    if (!file) {
+      close(fd);
+      std::remove(tmp_filename.c_str());
+    }
+  }
+  if (!file) {
+    lg::e(TAG, "Cannot write mesh cache %s", cache_filename.c_str());
+    return;
+  }
+
+  std::fwrite(&hdr, sizeof(hdr), 1, file);
+  std::fwrite(m_positions.data(), sizeof(Point3), m_positions.size(), file);
+  std::fwrite(m_normals.data(), sizeof(Normal3), m_normals.size(), file);
+  std::fwrite(m_faces.data(), sizeof(Face), m_faces.size(), file);
+  std::fwrite(m_edges.data(), sizeof(Edge), m_edges.size(), file);
+  for (const auto &level : m_levels) {
+    std::fwrite(level.faces.data(), sizeof(Face), level.faces.size(), file);
+  }
+
+  bool ok = !std::ferror(file);
+  ok = (std::fclose(file) == 0) && ok;
+
+  if (!ok || std::rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    lg::e(TAG, "Cannot write mesh cache %s", cache_filename.c_str());
+    std::remove(tmp_filename.c_str());
+  }
+}
+
+} // namespace agl
@@ -0,0 +1,311 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+/*
+ * Mesh optimization stage, run by loadMesh() right after parsing.
+ *  - vertices closer than a small epsilon are welded together
+ *  - zero-area triangles are dropped
+ *  - triangles are reordered for the post-transform vertex cache (Forsyth,
+ *    "Linear-Speed Vertex Cache Optimisation"), then vertices are renumbered
+ *    in order of first use, so that the vertex fetch is linear as well.
+ */
+
+namespace agl {
+
+namespace {
+// weld distance, relative to the bounding box diagonal
+static const float WELD_EPSILON = 1e-5f;
+
+// FIFO cache used to measure the ACMR: a typical post-transform cache size
+static const size_t ACMR_CACHE_SIZE = 16;
+
+// Forsyth's tuning
+static const size_t FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_DECAY_POWER = 1.5f;
+static const float FORSYTH_LAST_TRI_SCORE = .75f;
+static const float FORSYTH_VALENCE_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_POWER = .5f;
+
+// average cache miss ratio: transformed vertices per triangle
+float acmr(const std::vector<Face> &faces) {
+  if (faces.empty()) {
+    return 0.0f;
+  }
+
+  std::vector<Index> fifo;
+  size_t misses = 0;
+  for (const auto &face : faces) {
+    for (auto index : face.verts) {
+      if (std::find(fifo.begin(), fifo.end(), index) == fifo.end()) {
+        misses++;
+        fifo.push_back(index);
+        if (fifo.size() > ACMR_CACHE_SIZE) {
+          fifo.erase(fifo.begin());
+        }
+      }
+    }
+  }
+  return float(misses) / faces.size();
+}
+
+// score of a vertex, given its position in the LRU cache (-1 if not there)
+// and the number of triangles still using it
+float vertexScore(int cache_pos, size_t remaining) {
+  if (remaining == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_pos >= 0) {
+    if (cache_pos < 3) {
+      // the last triangle: a fixed score, to avoid favouring a strip order
+      score = FORSYTH_LAST_TRI_SCORE;
+    } else {
+      float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cache_pos - 3) * scaler, FORSYTH_DECAY_POWER);
+    }
+  }
+
+  // boost the vertices with few triangles left, to get rid of them quickly
+  score += FORSYTH_VALENCE_SCALE *
+           std::pow(float(remaining), -FORSYTH_VALENCE_POWER);
+  return score;
+}
+
+// hash of a cell of the welding grid
+inline uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+  return (uint64_t(x & 0x1fffff) << 42) | (uint64_t(y & 0x1fffff) << 21) |
+         uint64_t(z & 0x1fffff);
+}
+} // namespace
+
+// Forsyth: greedily emit the triangle with the best score, where the score
+// favours vertices that are in the simulated cache and vertices with few
+// triangles left
+void Mesh::reorderFaces(std::vector<Face> &faces, size_t n_verts) {
+  const size_t nf = faces.size();
+  if (nf == 0) {
+    return;
+  }
+
+  // triangles of each vertex, packed: vertex v owns
+  // tris[offsets[v] .. offsets[v] + remaining[v])
+  std::vector<size_t> remaining(n_verts, 0), offsets(n_verts + 1, 0);
+  for (const auto &face : faces) {
+    for (auto index : face.verts) {
+      remaining[index]++;
+    }
+  }
+  for (size_t v = 0; v < n_verts; ++v) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<uint32_t> tris(offsets[n_verts]);
+  std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t f = 0; f < nf; ++f) {
+    for (auto index : faces[f].verts) {
+      tris[fill[index]++] = f;
+    }
+  }
+
+  std::vector<int> cache_pos(n_verts, -1);
+  std::vector<float> vert_score(n_verts);
+  for (size_t v = 0; v < n_verts; ++v) {
+    vert_score[v] = vertexScore(-1, remaining[v]);
+  }
+
+  std::vector<float> tri_score(nf);
+  std::vector<bool> emitted(nf, false);
+  for (size_t f = 0; f < nf; ++f) {
+    const auto &v = faces[f].verts;
+    tri_score[f] = vert_score[v[0]] + vert_score[v[1]] + vert_score[v[2]];
+  }
+
+  std::vector<Face> out;
+  out.reserve(nf);
+  std::vector<Index> cache, new_cache;
+  size_t cursor = 0; // all the triangles before it have been emitted
+  long best = -1;
+
+  while (out.size() < nf) {
+    if (best < 0) {
+      // nothing useful in the cache: best of the remaining triangles.
+      // Scanning from the cursor keeps this linear in practice
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = cursor;
+      for (size_t f = cursor; f < nf; ++f) {
+        if (!emitted[f] && tri_score[f] > tri_score[best]) {
+          best = f;
+        }
+      }
+    }
+
+    const Face face = faces[best];
+    emitted[best] = true;
+    out.push_back(face);
+
+    // the triangle goes away from the lists of its vertices
+    for (auto index : face.verts) {
+      auto begin = tris.begin() + offsets[index];
+      auto end = begin + remaining[index];
+      std::iter_swap(std::find(begin, end, uint32_t(best)), end - 1);
+      remaining[index]--;
+    }
+
+    // its vertices go to the front of the cache
+    new_cache.assign(face.verts, face.verts + 3);
+    for (auto index : cache) {
+      if (index != face.verts[0] && index != face.verts[1] &&
+          index != face.verts[2]) {
+        new_cache.push_back(index);
+      }
+    }
+    // evicted vertices score as out of the cache again, and so do their
+    // triangles for the scan of the remaining ones
+    for (size_t i = FORSYTH_CACHE_SIZE; i < new_cache.size(); ++i) {
+      Index index = new_cache[i];
+      cache_pos[index] = -1;
+      vert_score[index] = vertexScore(-1, remaining[index]);
+      for (size_t j = 0; j < remaining[index]; ++j) {
+        uint32_t f = tris[offsets[index] + j];
+        const auto &v = faces[f].verts;
+        tri_score[f] = vert_score[v[0]] + vert_score[v[1]] + vert_score[v[2]];
+      }
+    }
+    if (new_cache.size() > FORSYTH_CACHE_SIZE) {
+      new_cache.resize(FORSYTH_CACHE_SIZE);
+    }
+    cache.swap(new_cache);
+
+    // update the scores around the cache and pick the next triangle
+    for (size_t i = 0; i < cache.size(); ++i) {
+      cache_pos[cache[i]] = i;
+      vert_score[cache[i]] = vertexScore(i, remaining[cache[i]]);
+    }
+
+    best = -1;
+    float best_score = -1.0f;
+    for (auto index : cache) {
+      for (size_t i = 0; i < remaining[index]; ++i) {
+        uint32_t f = tris[offsets[index] + i];
+        const auto &v = faces[f].verts;
+        tri_score[f] = vert_score[v[0]] + vert_score[v[1]] + vert_score[v[2]];
+        if (tri_score[f] > best_score) {
+          best_score = tri_score[f];
+          best = f;
+        }
+      }
+    }
+  }
+
+  faces.swap(out);
+}
+
+// weld, drop degenerates and reorder. Must run before init()
+void Mesh::optimize() {
+  static const auto TAG = __func__;
+
+  const size_t nv = m_positions.size();
+  const float acmr_before = acmr(m_faces);
+
+  // saldatura: vertices are bucketed in a grid of epsilon sized cells, each
+  // one is merged with the first earlier vertex found in the 27 cells around
+  Point3 lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+  for (const auto &p : m_positions) {
+    lo.x = std::min(lo.x, p.x);
+    lo.y = std::min(lo.y, p.y);
+    lo.z = std::min(lo.z, p.z);
+    hi.x = std::max(hi.x, p.x);
+    hi.y = std::max(hi.y, p.y);
+    hi.z = std::max(hi.z, p.z);
+  }
+  const float eps = nv ? WELD_EPSILON * (hi - lo).modulo() : 0.0f;
+
+  std::vector<Index> weld(nv);
+  for (size_t i = 0; i < nv; ++i) {
+    weld[i] = i;
+  }
+
+  if (eps > 0.0f) {
+    std::unordered_multimap<uint64_t, Index> grid;
+    grid.reserve(nv);
+    const float eps2 = eps * eps;
+    for (size_t i = 0; i < nv; ++i) {
+      const auto &p = m_positions[i];
+      int64_t cx = int64_t(std::floor((p.x - lo.x) / eps));
+      int64_t cy = int64_t(std::floor((p.y - lo.y) / eps));
+      int64_t cz = int64_t(std::floor((p.z - lo.z) / eps));
+
+      bool found = false;
+      for (int64_t dx = -1; dx <= 1 && !found; ++dx) {
+        for (int64_t dy = -1; dy <= 1 && !found; ++dy) {
+          for (int64_t dz = -1; dz <= 1 && !found; ++dz) {
+            auto range = grid.equal_range(cellKey(cx + dx, cy + dy, cz + dz));
+            for (auto it = range.first; it != range.second; ++it) {
+              Vec3 d = m_positions[it->second] - p;
+              if (d.x * d.x + d.y * d.y + d.z * d.z <= eps2) {
+                weld[i] = it->second;
+                found = true;
+                break;
+              }
+            }
+          }
+        }
+      }
+
+      if (!found) {
+        grid.emplace(cellKey(cx, cy, cz), Index(i));
+      }
+    }
+  }
+
+  // triangles with a repeated vertex or no area are dropped
+  size_t n_degenerate = 0;
+  std::vector<Face> faces;
+  faces.reserve(m_faces.size());
+  for (const auto &face : m_faces) {
+    Face welded = {{weld[face.verts[0]], weld[face.verts[1]],
+                    weld[face.verts[2]]}};
+    const auto &p0 = m_positions[welded.verts[0]];
+    Vec3 n = (m_positions[welded.verts[1]] - p0) %
+             (m_positions[welded.verts[2]] - p0);
+    if (!(n.x != 0.0f || n.y != 0.0f || n.z != 0.0f)) {
+      n_degenerate++;
+      continue;
+    }
+    faces.push_back(welded);
+  }
+
+  reorderFaces(faces, nv);
+
+  // rinumero i vertici in ordine di primo utilizzo: unused (welded)
+  // vertices are dropped on the way
+  static const Index UNUSED = ~Index(0);
+  std::vector<Index> remap(nv, UNUSED);
+  std::vector<Point3> positions;
+  positions.reserve(nv);
+  for (auto &face : faces) {
+    for (auto &index : face.verts) {
+      if (remap[index] == UNUSED) {
+        remap[index] = positions.size();
+        positions.push_back(m_positions[index]);
+      }
+      index = remap[index];
+    }
+  }
+
+  lg::i(TAG,
+        "%zu -> %zu vertices, %zu degenerate triangles removed, "
+        "ACMR %.3f -> %.3f",
+        nv, positions.size(), n_degenerate, acmr_before, acmr(faces));
+
+  m_positions.swap(positions);
+  m_faces.swap(faces);
+}
+
+} // namespace agl
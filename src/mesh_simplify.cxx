@@ -0,0 +1,345 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Level of detail chain of a Mesh.
+ * Simplified levels are built with quadric error metric edge collapses
+ * (Garland & Heckbert), where an edge is always collapsed onto one of its two
+ * endpoints: no new vertex is ever created, so all the levels share the
+ * positions and normals of the full resolution mesh and only differ in their
+ * faces (and index buffer).
+ */
+
+namespace agl {
+
+namespace {
+// fraction of the original triangles kept by each level
+static const float LOD_RATIOS[MESH_LOD_LEVELS] = {.5f, .25f, .1f};
+
+// border edges get a very heavy constraint plane: the silhouette of open
+// meshes (e.g. the door) must not shrink
+static const double BORDER_WEIGHT = 1000.0;
+
+// projected radius, in pixels, below which each level kicks in
+static const float LOD_PIXEL_RADIUS[MESH_LOD_LEVELS] = {120.0f, 50.0f, 20.0f};
+
+// symmetric 4x4 error matrix, stored as its upper triangle
+struct Quadric {
+  double a[10];
+
+  Quadric() { std::fill(a, a + 10, 0.0); }
+
+  // squared distance from the plane nx*x + ny*y + nz*z + d = 0, weighted
+  Quadric(double nx, double ny, double nz, double d, double w) {
+    a[0] = w * nx * nx;
+    a[1] = w * nx * ny;
+    a[2] = w * nx * nz;
+    a[3] = w * nx * d;
+    a[4] = w * ny * ny;
+    a[5] = w * ny * nz;
+    a[6] = w * ny * d;
+    a[7] = w * nz * nz;
+    a[8] = w * nz * d;
+    a[9] = w * d * d;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    for (size_t i = 0; i < 10; ++i) {
+      a[i] += other.a[i];
+    }
+    return *this;
+  }
+
+  double error(const Point3 &p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x +
+           a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y + a[7] * z * z +
+           2 * a[8] * z + a[9];
+  }
+};
+
+// a candidate collapse of the edge (from, to) onto "to".
+// The stamps are the ones of the two vertices when the candidate was pushed:
+// if any of them changed since, the candidate is stale
+struct Collapse {
+  double cost;
+  Index from, to;
+  uint32_t stamp_from, stamp_to;
+
+  bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+inline uint64_t edgeKey(Index a, Index b) {
+  return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+}
+
+// unnormalized normal of the triangle (a, b, c)
+inline Vec3 triangleNormal(const Point3 &a, const Point3 &b, const Point3 &c) {
+  return (b - a) % (c - a);
+}
+
+inline float dot(const Vec3 &a, const Vec3 &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Semplificazione: collassa gli edge di costo minimo finche' il numero di
+// facce non scende sotto ciascun target (in ordine decrescente).
+// One run produces all the levels: a snapshot of the live faces is taken
+// each time a target is reached.
+std::vector<std::vector<Face>>
+simplify(const std::vector<Point3> &positions, const std::vector<Face> &faces,
+         const std::vector<size_t> &targets) {
+  const size_t nv = positions.size();
+  const size_t nf = faces.size();
+
+  std::vector<Face> work(faces);
+  std::vector<bool> alive(nf, true);
+  std::vector<std::vector<uint32_t>> vert_faces(nv);
+  std::vector<Quadric> quadrics(nv);
+  size_t n_alive = nf;
+
+  // plane of each face, weighted by its area, accumulated on its vertices.
+  // The border edges are found on the way: they belong to a single face
+  std::unordered_map<uint64_t, int> edge_faces;
+  edge_faces.reserve(nf * 2);
+  for (size_t f = 0; f < nf; ++f) {
+    const auto &v = work[f].verts;
+    Vec3 n = triangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+    float len = n.modulo();
+    if (!(len > 0.0f)) {
+      // degenerate: nothing to draw
+      alive[f] = false;
+      n_alive--;
+      continue;
+    }
+
+    n = n / len;
+    Quadric q(n.x, n.y, n.z, -dot(n, positions[v[0]]), len / 2);
+    for (size_t k = 0; k < 3; ++k) {
+      quadrics[v[k]] += q;
+      vert_faces[v[k]].push_back(f);
+
+      uint64_t key = edgeKey(v[k], v[(k + 1) % 3]);
+      auto it = edge_faces.find(key);
+      if (it == edge_faces.end()) {
+        edge_faces.emplace(key, int(f));
+      } else {
+        it->second = -1; // shared
+      }
+    }
+  }
+
+  for (const auto &entry : edge_faces) {
+    if (entry.second < 0) {
+      continue;
+    }
+    Index a = Index(entry.first >> 32), b = Index(entry.first & 0xffffffff);
+    const auto &v = work[entry.second].verts;
+    Vec3 n = triangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+    Vec3 e = positions[b] - positions[a];
+    // plane through the edge, perpendicular to its face
+    Vec3 p = e % n;
+    float len = p.modulo();
+    if (!(len > 0.0f)) {
+      continue;
+    }
+    p = p / len;
+    Quadric q(p.x, p.y, p.z, -dot(p, positions[a]),
+              BORDER_WEIGHT * dot(e, e));
+    quadrics[a] += q;
+    quadrics[b] += q;
+  }
+
+  std::vector<uint32_t> stamps(nv, 0);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+
+  // push the cheapest of the two directions of the edge (a, b)
+  auto push = [&](Index a, Index b) {
+    Quadric q = quadrics[a];
+    q += quadrics[b];
+    double cost_a = q.error(positions[a]); // b collapsed onto a
+    double cost_b = q.error(positions[b]); // a collapsed onto b
+    if (cost_a <= cost_b) {
+      heap.push(Collapse{cost_a, b, a, stamps[b], stamps[a]});
+    } else {
+      heap.push(Collapse{cost_b, a, b, stamps[a], stamps[b]});
+    }
+  };
+
+  for (const auto &entry : edge_faces) {
+    push(Index(entry.first >> 32), Index(entry.first & 0xffffffff));
+  }
+
+  // snapshot of the current live faces
+  std::vector<std::vector<Face>> levels;
+  auto snapshot = [&]() {
+    std::vector<Face> level;
+    level.reserve(n_alive);
+    for (size_t f = 0; f < nf; ++f) {
+      if (alive[f]) {
+        level.push_back(work[f]);
+      }
+    }
+    levels.push_back(std::move(level));
+  };
+
+  std::vector<Index> neighbours;
+  size_t next = 0;
+  while (next < targets.size()) {
+    if (n_alive <= targets[next] || heap.empty()) {
+      snapshot();
+      next++;
+      continue;
+    }
+
+    Collapse c = heap.top();
+    heap.pop();
+    if (c.stamp_from != stamps[c.from] || c.stamp_to != stamps[c.to]) {
+      continue;
+    }
+
+    // reject the collapse if any of the surviving faces would flip
+    bool flips = false;
+    for (auto f : vert_faces[c.from]) {
+      if (!alive[f]) {
+        continue;
+      }
+      const auto &v = work[f].verts;
+      if (v[0] == c.to || v[1] == c.to || v[2] == c.to) {
+        continue;
+      }
+      Point3 p[3] = {positions[v[0]], positions[v[1]], positions[v[2]]};
+      Vec3 before = triangleNormal(p[0], p[1], p[2]);
+      for (size_t k = 0; k < 3; ++k) {
+        if (v[k] == c.from) {
+          p[k] = positions[c.to];
+        }
+      }
+      Vec3 after = triangleNormal(p[0], p[1], p[2]);
+      if (dot(before, after) <= 0.0f) {
+        flips = true;
+        break;
+      }
+    }
+    if (flips) {
+      continue;
+    }
+
+    // collapse: faces sharing the edge disappear, the others are moved
+    for (auto f : vert_faces[c.from]) {
+      if (!alive[f]) {
+        continue;
+      }
+      auto &v = work[f].verts;
+      if (v[0] == c.to || v[1] == c.to || v[2] == c.to) {
+        alive[f] = false;
+        n_alive--;
+        continue;
+      }
+      for (auto &index : v) {
+        if (index == c.from) {
+          index = c.to;
+        }
+      }
+      vert_faces[c.to].push_back(f);
+    }
+    vert_faces[c.from].clear();
+    quadrics[c.to] += quadrics[c.from];
+    stamps[c.from]++;
+    stamps[c.to]++;
+
+    // the cost of every edge around "to" changed
+    neighbours.clear();
+    for (auto f : vert_faces[c.to]) {
+      if (!alive[f]) {
+        continue;
+      }
+      for (auto index : work[f].verts) {
+        if (index != c.to) {
+          neighbours.push_back(index);
+        }
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+    for (auto n : neighbours) {
+      push(c.to, n);
+    }
+  }
+
+  return levels;
+}
+} // namespace
+
+// build the simplified levels, with LOD_RATIOS of the original faces
+void Mesh::buildLevels() {
+  static const auto TAG = __func__;
+
+  std::vector<size_t> targets;
+  for (auto ratio : LOD_RATIOS) {
+    targets.push_back(size_t(m_faces.size() * ratio));
+  }
+
+  auto levels = simplify(m_positions, m_faces, targets);
+
+  m_levels.clear();
+  m_levels.resize(levels.size());
+  for (size_t i = 0; i < levels.size(); ++i) {
+    m_levels[i].faces = std::move(levels[i]);
+    reorderFaces(m_levels[i].faces, m_positions.size());
+  }
+
+  std::string counts = std::to_string(m_faces.size());
+  for (const auto &level : m_levels) {
+    counts += " / " + std::to_string(level.faces.size());
+  }
+  lg::i(TAG, "LOD chain built: %s triangles", counts.c_str());
+}
+
+// pick the level for the next draw from the size of the bounding sphere
+// projected on the screen, with the current modelview and projection
+size_t Mesh::selectLevel() const {
+  if (m_levels.empty()) {
+    return 0;
+  }
+
+  GLfloat mv[16], proj[16];
+  GLint viewport[4];
+  glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+  glGetFloatv(GL_PROJECTION_MATRIX, proj);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  // sphere center in eye space (only z is needed) and radius, scaled as the
+  // modelview scales the first axis
+  Point3 c = (bbmin + bbmax) / 2.0;
+  float radius = (bbmax - bbmin).modulo() / 2;
+  float z = mv[2] * c.x + mv[6] * c.y + mv[10] * c.z + mv[14];
+  float scale = std::sqrt(mv[0] * mv[0] + mv[1] * mv[1] + mv[2] * mv[2]);
+  radius *= scale;
+
+  // camera inside the sphere
+  if (-z <= radius) {
+    return 0;
+  }
+
+  // proj[5] = cot(fovy / 2)
+  float pixels = radius * proj[5] / -z * viewport[3] / 2;
+
+  size_t level = 0;
+  while (level < m_levels.size() && pixels < LOD_PIXEL_RADIUS[level]) {
+    level++;
+  }
+  return level;
+}
+
+} // namespace agl
@@ -60,16 +60,4 @@ void Normal3::render() const {
   glNormal3fv(coords);
 }
 
-// Vertex constructor, initialize both its "views"
-Vertex::Vertex(const Point3 &p) : point(p), normal(0, 0, 0) {}
-
-// if send_normal true, renders also the normal, otherwise only vertices
-void Vertex::render(bool send_normal) const {
-  if (send_normal) {
-    normal.render();
-  }
-
-  float coords[]{point.x, point.y, point.z};
-  glVertex3fv(coords);
-}
 } // namespace agl
@@ -0,0 +1,127 @@
+#include "agl.h"
+
+#include <algorithm>
+#include <tuple>
+
+/*
+ * RenderQueue: the scene is first collected as draw items, then drawn in two
+ * passes. Opaque items are sorted by material, so that items sharing the same
+ * texture/lighting/geometry are drawn one after the other and the state is
+ * set once; transparent items are drawn last, from the farthest to the
+ * nearest, so that they blend over what is behind them. See agl.h
+ */
+
+namespace agl {
+
+namespace {
+// blending first, so that the key can be used for both passes. Geometry is
+// the last: binding a buffer is cheaper than binding a texture
+bool materialLess(const Material &a, const Material &b) {
+  return std::make_tuple(a.blend, a.textured, a.texture, a.texgen,
+                         a.lighting, a.geometry) <
+         std::make_tuple(b.blend, b.textured, b.texture, b.texgen,
+                         b.lighting, b.geometry);
+}
+} // namespace
+
+RenderQueue::RenderQueue() : m_env(get_env()), m_bound(nullptr) {}
+
+void RenderQueue::submit(const Material &material, const Point3 &center,
+                         std::function<void()> draw) {
+  Item item{material, m_env.viewDepth(center), draw};
+  if (material.blend) {
+    m_transparent.push_back(item);
+  } else {
+    m_opaque.push_back(item);
+  }
+}
+
+// the whole material is set for each item: what's already in place is
+// filtered by the GL state tracker
+void RenderQueue::apply(const Material &material) {
+  auto &gl = m_env.gl();
+
+  gl.set(GL_LIGHTING, material.lighting);
+
+  gl.set(GL_TEXTURE_2D, material.textured);
+  if (material.textured) {
+    gl.bindTexture(material.texture);
+  }
+
+  gl.set(GL_TEXTURE_GEN_S, material.texgen);
+  gl.set(GL_TEXTURE_GEN_T, material.texgen);
+  if (material.texgen) {
+    GLint mode = m_env.isEnvmap() ? GL_SPHERE_MAP : GL_OBJECT_LINEAR;
+    gl.texGen(GL_S, mode);
+    gl.texGen(GL_T, mode);
+  }
+
+  gl.set(GL_BLEND, material.blend);
+  if (material.blend) {
+    gl.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+
+  // lighting and texgen state above is ignored by the program: it takes
+  // them from the material
+  if (m_env.isShaders()) {
+    m_env.shaders().setMaterial(material, m_env.isEnvmap());
+  }
+
+  // the geometry stays bound as long as the next items use it
+  if (material.geometry != m_bound) {
+    if (m_bound) {
+      m_bound->unbind();
+    }
+    m_bound = material.geometry;
+    if (m_bound) {
+      // generated coordinates don't need the texture coordinates array
+      m_bound->bind(material.textured && !material.texgen);
+    }
+  }
+}
+
+void RenderQueue::flush() {
+  std::stable_sort(m_opaque.begin(), m_opaque.end(),
+                   [](const Item &a, const Item &b) {
+                     return materialLess(a.material, b.material);
+                   });
+  // back to front
+  std::stable_sort(m_transparent.begin(), m_transparent.end(),
+                   [](const Item &a, const Item &b) {
+                     return a.depth > b.depth;
+                   });
+
+  bool shaders = m_env.isShaders();
+  if (shaders) {
+    m_env.shaders().begin();
+  }
+
+  for (auto pass : {&m_opaque, &m_transparent}) {
+    for (const auto &item : *pass) {
+      apply(item.material);
+      item.draw();
+    }
+  }
+
+  if (m_bound) {
+    m_bound->unbind();
+    m_bound = nullptr;
+  }
+
+  if (shaders) {
+    m_env.shaders().end();
+  }
+
+  // leave the state the rest of the frame expects
+  auto &gl = m_env.gl();
+  gl.disable(GL_BLEND);
+  gl.disable(GL_TEXTURE_GEN_T);
+  gl.disable(GL_TEXTURE_GEN_S);
+  gl.disable(GL_TEXTURE_2D);
+  gl.enable(GL_LIGHTING);
+
+  m_opaque.clear();
+  m_transparent.clear();
+}
+
+} // namespace agl
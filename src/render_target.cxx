@@ -0,0 +1,97 @@
+#include "agl.h"
+
+#include <algorithm>
+
+/*
+ * RenderTarget: offscreen framebuffer with a colour texture and a depth
+ * buffer. See agl.h
+ */
+
+namespace agl {
+
+RenderTarget::RenderTarget()
+    : m_fbo(0), m_texture(0), m_depth(0), m_size(0) {}
+
+RenderTarget::~RenderTarget() { release(); }
+
+bool RenderTarget::supported() {
+  return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+bool RenderTarget::init(size_t size) {
+  static const auto TAG = __func__;
+
+  release();
+  if (!supported()) {
+    lg::i(TAG, "No framebuffer objects: offscreen rendering not available");
+    return false;
+  }
+
+  GLint max_texture = 0, max_renderbuffer = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture);
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_renderbuffer);
+  if (size == 0 || size > size_t(std::min(max_texture, max_renderbuffer))) {
+    lg::e(TAG, "Render target of %zu pixels not supported (max %d)", size,
+          std::min(max_texture, max_renderbuffer));
+    return false;
+  }
+
+  auto &gl = get_env().gl();
+  glGenTextures(1, &m_texture);
+  gl.bindTexture(m_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glGenRenderbuffers(1, &m_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_texture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, m_depth);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    lg::e(TAG, "Incomplete framebuffer (0x%x)", status);
+    release();
+    return false;
+  }
+
+  m_size = size;
+  return true;
+}
+
+void RenderTarget::begin() {
+  glGetIntegerv(GL_VIEWPORT, m_viewport);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_size, m_size);
+}
+
+void RenderTarget::end() {
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+}
+
+void RenderTarget::release() {
+  if (m_fbo) {
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteRenderbuffers(1, &m_depth);
+    m_fbo = m_depth = 0;
+  }
+  if (m_texture) {
+    get_env().gl().deleteTexture(m_texture);
+    m_texture = 0;
+  }
+  m_size = 0;
+}
+
+} // namespace agl
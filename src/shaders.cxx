@@ -0,0 +1,321 @@
+#include "agl.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+/*
+ * ShaderPipeline: GLSL alternative to the fixed-function lighting and
+ * texture coordinate generation, for the items of the render queue.
+ *
+ * The program is GLSL 3.30 in the compatibility profile: the matrix stack,
+ * vertex arrays and glColor() still feed it through the built-in inputs, so
+ * every draw path of the game works unchanged with both pipelines. Camera and
+ * light data go in two uniform buffers, updated once per frame.
+ * See agl.h
+ */
+
+namespace agl {
+
+namespace {
+// uniform buffer binding points
+const GLuint CAMERA_BINDING = 0;
+const GLuint LIGHT_BINDING = 1;
+
+const char *VERTEX_SHADER = R"(
+#version 330 compatibility
+
+layout(std140) uniform Camera {
+  mat4 projection;
+};
+
+uniform int u_texgen; // 0: texture coords, 1: object linear, 2: sphere map
+
+out vec3 v_position; // eye space
+out vec3 v_normal;   // eye space
+out vec2 v_uv;
+out vec4 v_color;
+
+void main() {
+  vec4 eye = gl_ModelViewMatrix * gl_Vertex;
+  v_position = eye.xyz;
+  v_normal = gl_NormalMatrix * gl_Normal;
+  v_color = gl_Color;
+  // object linear with the default GL planes: s = x, t = y
+  v_uv = u_texgen == 1 ? gl_Vertex.xy : gl_MultiTexCoord0.xy;
+  gl_Position = projection * eye;
+}
+)";
+
+const char *FRAGMENT_SHADER = R"(
+#version 330 compatibility
+
+layout(std140) uniform Light {
+  vec4 light_position;    // eye space, w = 0: directional
+  vec4 light_ambient;     // global ambient included
+  vec4 light_diffuse;
+  vec4 light_specular;
+  vec4 material_specular; // w: shininess
+  vec4 spot_position;     // eye space
+  vec4 spot_direction;    // eye space, w: cosine of the cutoff
+  vec4 spot_ambient;
+  vec4 spot_diffuse;
+  vec4 spot_params;       // constant, linear attenuation, exponent, on
+};
+
+uniform sampler2D u_texture;
+uniform bool u_textured;
+uniform bool u_lighting;
+uniform int u_texgen;
+
+in vec3 v_position;
+in vec3 v_normal;
+in vec2 v_uv;
+in vec4 v_color;
+
+out vec4 frag_color;
+
+void main() {
+  vec4 color = v_color;
+  vec3 n = normalize(v_normal);
+
+  // per pixel Blinn-Phong, colour material on ambient and diffuse as in the
+  // fixed-function setup
+  if (u_lighting) {
+    vec3 l = light_position.w == 0.0
+                 ? normalize(light_position.xyz)
+                 : normalize(light_position.xyz - v_position);
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) {
+      vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));
+      specular = pow(max(dot(n, h), 0.0), material_specular.w);
+    }
+    color.rgb = v_color.rgb * (light_ambient.rgb + diffuse * light_diffuse.rgb) +
+                specular * light_specular.rgb * material_specular.rgb;
+
+    // spot light: nothing outside the cone, attenuated with the distance
+    if (spot_params.w != 0.0) {
+      vec3 d = spot_position.xyz - v_position;
+      float dist = length(d);
+      vec3 ls = d / dist;
+      float cos_angle = dot(-ls, normalize(spot_direction.xyz));
+      if (cos_angle >= spot_direction.w) {
+        float att = pow(cos_angle, spot_params.z) /
+                    (spot_params.x + spot_params.y * dist);
+        color.rgb += v_color.rgb * att *
+                     (spot_ambient.rgb +
+                      max(dot(n, ls), 0.0) * spot_diffuse.rgb);
+      }
+    }
+  }
+
+  if (u_textured) {
+    vec2 uv = v_uv;
+    // sphere map from the per pixel reflection vector
+    if (u_texgen == 2) {
+      vec3 r = reflect(normalize(v_position), n);
+      float m = 2.0 * sqrt(r.x * r.x + r.y * r.y + (r.z + 1.0) * (r.z + 1.0));
+      uv = r.xy / m + 0.5;
+    }
+    color *= texture(u_texture, uv);
+  }
+
+  frag_color = color;
+}
+)";
+
+// std140 layout of the Light block
+struct LightBlock {
+  float position[4];
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float material_specular[4];
+  float spot_position[4];
+  float spot_direction[4];
+  float spot_ambient[4];
+  float spot_diffuse[4];
+  float spot_params[4];
+};
+
+GLuint compile(GLenum type, const char *source) {
+  static const auto TAG = __func__;
+
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    GLint len = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+    std::vector<char> log(len + 1, '\0');
+    glGetShaderInfoLog(shader, len, nullptr, log.data());
+    lg::e(TAG, "%s shader: %s",
+          type == GL_VERTEX_SHADER ? "vertex" : "fragment", log.data());
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+} // namespace
+
+ShaderPipeline::ShaderPipeline()
+    : m_program(0), m_camera(GL_UNIFORM_BUFFER), m_light(GL_UNIFORM_BUFFER),
+      m_loc_texgen(-1), m_loc_textured(-1), m_loc_lighting(-1),
+      m_light_position{0, 0, 1, 0}, m_material_specular{0, 0, 0, 1},
+      m_spot(), m_spot_on(false), m_active(false) {}
+
+ShaderPipeline::~ShaderPipeline() { release(); }
+
+void ShaderPipeline::release() {
+  if (m_program) {
+    glDeleteProgram(m_program);
+    m_program = 0;
+  }
+  m_camera.release();
+  m_light.release();
+}
+
+bool ShaderPipeline::supported() {
+  return GLEW_VERSION_3_3 ||
+         (GLEW_VERSION_3_0 && GLEW_ARB_uniform_buffer_object);
+}
+
+bool ShaderPipeline::init() {
+  static const auto TAG = __func__;
+
+  if (!supported()) {
+    lg::i(TAG, "GL 3.3 not available: fixed-function pipeline");
+    return false;
+  }
+
+  GLuint vs = compile(GL_VERTEX_SHADER, VERTEX_SHADER);
+  GLuint fs = compile(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+  if (!vs || !fs) {
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return false;
+  }
+
+  m_program = glCreateProgram();
+  glAttachShader(m_program, vs);
+  glAttachShader(m_program, fs);
+  glLinkProgram(m_program);
+  // flagged for deletion, freed together with the program
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  GLint ok = GL_FALSE;
+  glGetProgramiv(m_program, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    GLint len = 0;
+    glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &len);
+    std::vector<char> log(len + 1, '\0');
+    glGetProgramInfoLog(m_program, len, nullptr, log.data());
+    lg::e(TAG, "link: %s", log.data());
+    glDeleteProgram(m_program);
+    m_program = 0;
+    return false;
+  }
+
+  glUniformBlockBinding(m_program,
+                        glGetUniformBlockIndex(m_program, "Camera"),
+                        CAMERA_BINDING);
+  glUniformBlockBinding(m_program, glGetUniformBlockIndex(m_program, "Light"),
+                        LIGHT_BINDING);
+  m_loc_texgen = glGetUniformLocation(m_program, "u_texgen");
+  m_loc_textured = glGetUniformLocation(m_program, "u_textured");
+  m_loc_lighting = glGetUniformLocation(m_program, "u_lighting");
+
+  // textures always come from unit 0
+  glUseProgram(m_program);
+  glUniform1i(glGetUniformLocation(m_program, "u_texture"), 0);
+  glUseProgram(0);
+
+  lg::i(TAG, "GLSL pipeline ready (%s)", glGetString(GL_VERSION));
+  return true;
+}
+
+void ShaderPipeline::setLight(const float *eye_position) {
+  for (size_t i = 0; i < 4; ++i) {
+    m_light_position[i] = eye_position[i];
+  }
+}
+
+void ShaderPipeline::setSpecular(const float *specular, float shininess) {
+  for (size_t i = 0; i < 3; ++i) {
+    m_material_specular[i] = specular[i];
+  }
+  m_material_specular[3] = shininess;
+}
+
+void ShaderPipeline::setSpot(const SpotLight *eye_spot) {
+  m_spot_on = eye_spot != nullptr;
+  if (eye_spot) {
+    m_spot = *eye_spot;
+  }
+  // already drawing: the next items see it
+  if (m_active) {
+    uploadLight();
+  }
+}
+
+void ShaderPipeline::uploadLight() {
+  // GL_LIGHT0 defaults, plus the default global ambient (0.2)
+  LightBlock light = {{0, 0, 0, 0},
+                      {.2f, .2f, .2f, 1},
+                      {1, 1, 1, 1},
+                      {1, 1, 1, 1},
+                      {0, 0, 0, 0},
+                      {0, 0, 0, 0},
+                      {0, 0, 0, 0},
+                      {0, 0, 0, 0},
+                      {0, 0, 0, 0},
+                      {0, 0, 0, 0}};
+  for (size_t i = 0; i < 4; ++i) {
+    light.position[i] = m_light_position[i];
+    light.material_specular[i] = m_material_specular[i];
+    light.spot_position[i] = m_spot.position[i];
+    light.spot_direction[i] = m_spot.direction[i];
+    light.spot_ambient[i] = m_spot.ambient[i];
+    light.spot_diffuse[i] = m_spot.diffuse[i];
+  }
+  light.spot_direction[3] = std::cos(m_spot.cutoff * M_PI / 180.0);
+  light.spot_params[0] = m_spot.constant_attenuation;
+  light.spot_params[1] = m_spot.linear_attenuation;
+  light.spot_params[2] = m_spot.exponent;
+  light.spot_params[3] = m_spot_on ? 1.0f : 0.0f;
+  m_light.upload(&light, sizeof(light), GL_DYNAMIC_DRAW);
+}
+
+void ShaderPipeline::begin() {
+  float projection[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  m_camera.upload(projection, sizeof(projection), GL_DYNAMIC_DRAW);
+  uploadLight();
+
+  m_camera.bindBase(CAMERA_BINDING);
+  m_light.bindBase(LIGHT_BINDING);
+  glUseProgram(m_program);
+  m_active = true;
+}
+
+void ShaderPipeline::setMaterial(const Material &material, bool envmap) {
+  GLint texgen = 0;
+  if (material.texgen) {
+    texgen = envmap ? 2 : 1;
+  }
+  glUniform1i(m_loc_texgen, texgen);
+  glUniform1i(m_loc_textured, material.textured);
+  glUniform1i(m_loc_lighting, material.lighting);
+}
+
+void ShaderPipeline::end() {
+  glUseProgram(0);
+  m_active = false;
+}
+
+} // namespace agl
@@ -50,19 +50,31 @@ protected:
   std::queue<spaceship::Command> m_cmds;
 
   agl::Env &m_env;
-  agl::TexID m_tex;
-  std::unique_ptr<agl::Mesh>
-      m_mesh; // mesh structure for the Aventador Spaceship
+  // shared through the asset registry: a restart reuses them
+  agl::TextureHandle m_tex;
+  agl::MeshHandle m_mesh; // mesh structure for the Aventador Spaceship
   // angles, grip and friction
 
+  // shadow: a flat shape under the ship, rebuilt only when the mesh (or the
+  // shadow map size) changes. Either the footprint of the mesh, or a quad
+  // textured with its silhouette
+  agl::Geometry m_shadow_geo;
+  const agl::Mesh *m_shadow_mesh; // m_shadow_geo was built for this mesh
+  size_t m_shadow_size;           // ...and this shadow map size
+  agl::RenderTarget m_shadow_map;
+
   // protected constructor to ensure singleton instance
   // instance is obtained through get_spaceship()
   Spaceship(const char *texture_filename, const char *mesh_filename);
 
   // drawing methods
+  // model transform: position, facing and tilting
+  virtual void transform() const;
   void draw() const;
   void drawFlicker() const;
   void drawHeadlight(float x, float y, float z, int lightN) const;
+  void buildShadow();
+  void renderSilhouette();
 
   // inner logic and physics of the spaceship
   bool get_state(spaceship::Motion mt);
@@ -100,8 +112,8 @@ public:
   void scale(float x, float y, float z);
 
   // render the Spaceship: TexID + Mesh
-  virtual void render(bool flicker = false);
-  void shadow();
+  void submit(agl::RenderQueue &queue, bool flicker = false);
+  void shadow(agl::RenderQueue &queue);
 };
 
 class FlappyShip : Spaceship {
@@ -114,6 +126,9 @@ private:
   // methods for 3D flight only
   bool updateSteerFlight();
 
+  // tilting on the nose as well
+  void transform() const override;
+
   FlappyShip(const char *texture_filename, const char *mesh_filename);
 
 public:
@@ -121,8 +136,6 @@ public:
   friend std::unique_ptr<Spaceship> get_spaceship(const char *texture_filename,
                                                   const char *mesh_filename,
                                                   bool m_flappy3D);
-
-  void render(bool flicker = false) override;
 };
 
 std::unique_ptr<Spaceship> get_spaceship(const char *texture_filename,
@@ -31,20 +31,39 @@ SmartWindow::SmartWindow(std::string &name, size_t x, size_t y, size_t w,
     lg::e(TAG, "Window error: ", SDL_GetError());
   }
 
+  // load the GL entry points above 1.1 (buffer objects & co.)
+  GLenum glew_err = glewInit();
+  if (glew_err != GLEW_OK) {
+    lg::e(TAG, "GLEW error: %s", glewGetErrorString(glew_err));
+  }
+
+  if (!Buffer::supported()) {
+    lg::i(TAG, "No GL buffer objects: meshes will use immediate mode");
+  }
+
   lg::i(TAG, "init...");
 
-  glEnable(GL_DEPTH_TEST); // zbuffer
-  glEnable(GL_LIGHTING);   // lighting
-  glEnable(GL_LIGHT0);     // light0
-  glEnable(GL_NORMALIZE);  // normalize the vectors
+  // brand new context: whatever the tracker knew is gone
+  auto &gl = m_env.gl();
+  gl.invalidate();
+
+  gl.enable(GL_DEPTH_TEST); // zbuffer
+  gl.enable(GL_LIGHTING);   // lighting
+  gl.enable(GL_LIGHT0);     // light0
+  gl.enable(GL_NORMALIZE);  // normalize the vectors
 
   glFrontFace(GL_CW); // Front facing faces are taken clockwise
-  glEnable(GL_COLOR_MATERIAL);
+  gl.enable(GL_COLOR_MATERIAL);
   glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
-  glEnable(GL_POLYGON_OFFSET_FILL);
+  gl.enable(GL_POLYGON_OFFSET_FILL);
 
   // move fragment generated by rasterization back
   glPolygonOffset(1.0f, 1.0f); // set back
+
+  // GLSL pipeline, if requested: the fixed-function one is the fallback
+  if (m_env.isShadersRequested() && !m_env.shaders().init()) {
+    lg::i(TAG, "GLSL pipeline not available, using fixed-function GL");
+  }
 }
 
 // clean up window and context
@@ -52,6 +71,8 @@ SmartWindow::~SmartWindow() {
   static const auto TAG = __func__;
 
   lg::i(TAG, "deleting context and window");
+  // the Env is static: its GL objects must go with the context, not at exit
+  m_env.releaseGL();
   SDL_GL_DeleteContext(m_GLcontext);
   SDL_DestroyWindow(m_win);
 }
@@ -65,18 +86,15 @@ void SmartWindow::setupViewport() { glViewport(0, 0, m_width, m_height); }
 // shows the window
 void SmartWindow::show() { SDL_ShowWindow(m_win); }
 
-void SmartWindow::refresh() {
-  // wait for it
-  glFinish();
-  SDL_GL_SwapWindow(m_win);
-}
+// no glFinish: the pacer only waits when the GPU is frames behind
+void SmartWindow::refresh() { m_env.pacer().present(m_win); }
 
 // Helper function:
 // Set the world coords to map into the screen
 // Accepts a function fn to be executed afterwards
 void SmartWindow::printOnScreen(std::function<void()> fn) {
-  glDisable(GL_LIGHTING);
-  glDisable(GL_DEPTH_TEST);
+  m_env.gl().disable(GL_LIGHTING);
+  m_env.gl().disable(GL_DEPTH_TEST);
 
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
@@ -91,56 +109,25 @@ void SmartWindow::printOnScreen(std::function<void()> fn) {
     glScalef(2.0 / m_width, 2.0 / m_height, 1);
 
     fn();
+    m_batch.flush();
   });
 
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_LIGHTING);
+  m_env.gl().enable(GL_DEPTH_TEST);
+  m_env.gl().enable(GL_LIGHTING);
 }
 
 // color the whole window with a solid Color
 void SmartWindow::colorWindow(const Color &color) {
   printOnScreen([&] {
-    glColor3f(color.r, color.g, color.b);
-
-    glBegin(GL_POLYGON);
-    {
-      glVertex2f(0.0f, 0.0f);
-
-      glVertex2f(m_width, 0.0f);
-
-      glVertex2f(m_width, m_height);
-
-      glVertex2f(0.0f, m_height);
-    }
-    glEnd();
+    m_batch.quad(0.0f, 0.0f, m_width, m_height,
+                 Color(color.r, color.g, color.b));
   });
 }
 
 // Apply a texture on the whole window to show a background image
 void SmartWindow::textureWindow(TexID texbind) {
-  printOnScreen([&] {
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texbind);
-
-    glBegin(GL_POLYGON);
-    {
-      glTexCoord2f(0.0f, 0.0f);
-      glVertex2f(0.0f, 0.0f);
-
-      glTexCoord2f(1.0f, 0.0f);
-      glVertex2f(m_width, 0.0f);
-
-      glTexCoord2f(1.0f, 1.0f);
-      glVertex2f(m_width, m_height);
-
-      glTexCoord2f(0.0f, 1.0f);
-      glVertex2f(0.0f, m_height);
-    }
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-  });
+  printOnScreen(
+      [&] { m_batch.texturedRect(texbind, 0.0f, 0.0f, m_width, m_height); });
 }
 
 } // namespace agl
@@ -1,5 +1,7 @@
 #include "ship.h"
 
+#include <algorithm>
+
 namespace elements {
 /*                                *
  *                                *
@@ -33,9 +35,9 @@ std::unique_ptr<Spaceship> get_spaceship(const char *texture_filename,
 Spaceship::Spaceship(const char *texture_filename,
                      const char *mesh_filename) // da finire
     : m_env(agl::get_env()),
-      m_tex(m_env.loadTexture(texture_filename)), // no texture for now
-      m_mesh(agl::loadMesh(mesh_filename))        // TODO
-{
+      m_tex(agl::getTexture(texture_filename)), // no texture for now
+      m_mesh(agl::getMesh(mesh_filename, true)), // TODO
+      m_shadow_geo(GL_TRIANGLES), m_shadow_mesh(nullptr), m_shadow_size(0) {
   init();
 }
 
@@ -78,37 +80,39 @@ void Spaceship::init(bool truman) {
   decltype(m_cmds)().swap(m_cmds);
 }
 
-// draw the ship as a textured mesh, using the helper functions defined
-// in the Env class.
+// draw the ship as a textured mesh: texture and generated coordinates are
+// set by the render queue, see submit()
 void Spaceship::draw() const {
-  m_env.textureDrawing(m_tex, [&] {
-    m_env.mat_scope([&] {
-      m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
+  m_env.setColor(agl::WHITE);
+  m_env.mat_scope([&] {
+    m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
 
-      m_mesh->renderGouraud(m_env.isWireframe());
-    });
-  }); // generate coords automatically, true by default
+    m_mesh->renderGouraud(m_env.isWireframe());
+  });
 
   // if headlight is on in the Env, then draw headlights
   if (m_env.isHeadlight()) {
     // lg::i(__func__, "Headlights toggled!");
-    drawHeadlight(0, 0, -1, 8);
+    drawHeadlight(0, 0, -1, 0);
+  } else {
+    m_env.disableSpotLight(GL_LIGHT1);
   }
 }
 
 void Spaceship::drawFlicker() const {
-  m_env.textureDrawing(m_tex, [&] {
-    m_env.mat_scope([&] {
-      m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
+  m_env.setColor(agl::WHITE);
+  m_env.mat_scope([&] {
+    m_env.scale(m_scaleX, m_scaleY, m_scaleZ);
 
-      m_mesh->renderGouraud(true);
-    });
-  }); // generate coords automatically, true by default
+    m_mesh->renderGouraud(true);
+  });
 
   // if headlight is on in the Env, then draw headlights
   if (m_env.isHeadlight()) {
     // lg::i(__func__, "Headlights toggled!");
-    drawHeadlight(0, 0, -1, 8);
+    drawHeadlight(0, 0, -1, 0);
+  } else {
+    m_env.disableSpotLight(GL_LIGHT1);
   }
 }
 
@@ -117,25 +121,16 @@ void Spaceship::drawHeadlight(float x, float y, float z, int lightN) const {
 
   int usedLight = GL_LIGHT1 + lightN;
 
-  glEnable(usedLight);
-
-  float col0[4] = {0.8, 0.8, 0.0, 1};
-  glLightfv(usedLight, GL_DIFFUSE, col0);
-
-  float col1[4] = {0.5, 0.5, 0.0, 1};
-  glLightfv(usedLight, GL_AMBIENT, col1);
-
-  float tmpPos[4] = {x, y, z, 1}; // ultima comp=1 => luce posizionale
-  glLightfv(usedLight, GL_POSITION, tmpPos);
-
-  float tmpDir[4] = {0, 0, -1, 0}; // ultima comp=1 => luce posizionale
-  glLightfv(usedLight, GL_SPOT_DIRECTION, tmpDir);
-
-  glLightf(usedLight, GL_SPOT_CUTOFF, 30);
-  glLightf(usedLight, GL_SPOT_EXPONENT, 5);
-
-  glLightf(usedLight, GL_CONSTANT_ATTENUATION, 0);
-  glLightf(usedLight, GL_LINEAR_ATTENUATION, 1);
+  agl::SpotLight spot = {
+      {x, y, z, 1},       // ultima comp=1 => luce posizionale
+      {0, 0, -1, 0},      // direzione
+      {0.5, 0.5, 0.0, 1}, // ambient
+      {0.8, 0.8, 0.0, 1}, // diffuse
+      30,                 // cutoff
+      5,                  // exponent
+      0,                  // constant attenuation
+      1};                 // linear attenuation
+  m_env.setSpotLight(usedLight, spot);
 }
 
 void Spaceship::doMotion() {
@@ -280,29 +275,44 @@ void Spaceship::processCommand() {
   }
 }
 
-void Spaceship::render(bool flicker) {
-  m_env.mat_scope([&] {
+void Spaceship::transform() const {
+  // translate the camera to follow the ship movements
+  m_env.translate(m_px, m_py, m_pz);
 
-    // translate the camera to follow the ship movements
-    m_env.translate(m_px, m_py, m_pz);
+  // rotate the ship according to the facing direction
+  m_env.rotate(m_facing, m_viewUP);
 
-    // rotate the ship according to the facing direction
-    m_env.rotate(m_facing, m_viewUP);
+  // the Mesh is loaded on the other side
+  m_env.rotate(m_rotation_angle, m_viewUP);
 
-    // the Mesh is loaded on the other side
-    m_env.rotate(m_rotation_angle, m_viewUP);
+  // rotate the ship acc. to steering val, to represent tilting
+  int sign = m_rotation_angle == ENVOS_ANGLE ? -1 : 1;
+  m_env.rotate(sign * m_steering, m_front_axis);
+  //   m_env.rotate(sign * m_steering, front_boat);
+}
 
-    // rotate the ship acc. to steering val, to represent tilting
-    int sign = m_rotation_angle == ENVOS_ANGLE ? -1 : 1;
-    m_env.rotate(sign * m_steering, m_front_axis);
-    //   m_env.rotate(sign * m_steering, front_boat);
+void Spaceship::submit(agl::RenderQueue &queue, bool flicker) {
+  agl::Point3 center(m_px, m_py, m_pz);
+  float scale = std::max(m_scaleX, std::max(m_scaleY, m_scaleZ));
+  if (!m_env.isVisible(center, scale * m_mesh->radius())) {
+    return;
+  }
 
-    if (flicker) {
-      drawFlicker();
-    } else {
-      draw();
-    }
+  // generate coords automatically. Wireframe meshes aren't textured
+  agl::Material material;
+  material.texture = m_tex->id();
+  material.textured = material.texgen = !(flicker || m_env.isWireframe());
 
+  queue.submit(material, center, [this, flicker] {
+    m_env.mat_scope([&] {
+      transform();
+
+      if (flicker) {
+        drawFlicker();
+      } else {
+        draw();
+      }
+    });
   });
 }
 
@@ -321,29 +331,117 @@ void Spaceship::scale(float x, float y, float z) {
   m_scaleZ = z;
 }
 
-void Spaceship::shadow() {
-  m_env.mat_scope([&] {
-    const auto c = agl::SHADOW;
+// Shadows are cast along the Y axis of the mesh, squashed on the floor: the
+// shape only depends on the mesh, not on the ship movements
+void Spaceship::buildShadow() {
+  static const auto TAG = __func__;
+
+  m_shadow_geo.clear();
+  m_shadow_mesh = m_mesh.get();
+  m_shadow_size = m_env.get_shadow_map_size();
+
+  if (m_shadow_size > 0 && m_shadow_map.init(m_shadow_size)) {
+    // bounding box, the silhouette comes from the texture
+    const auto &lo = m_mesh->bbmin, &hi = m_mesh->bbmax;
+    m_shadow_geo.addVertex(lo.x, 0, lo.z, 0, 1, 0, 0, 1);
+    m_shadow_geo.addVertex(hi.x, 0, lo.z, 0, 1, 0, 1, 1);
+    m_shadow_geo.addVertex(hi.x, 0, hi.z, 0, 1, 0, 1, 0);
+    m_shadow_geo.addVertex(lo.x, 0, hi.z, 0, 1, 0, 0, 0);
+    for (agl::Index i : {0, 1, 2, 0, 2, 3}) {
+      m_shadow_geo.addIndex(i);
+    }
+    renderSilhouette();
+    lg::i(TAG, "Shadow map: %zux%zu", m_shadow_size, m_shadow_size);
+    return;
+  }
 
-    m_env.setColor(c);
-    m_env.disableLighting();
+  // triangle fan over the convex hull
+  const auto &hull = m_mesh->footprint();
+  for (const auto &p : hull) {
+    m_shadow_geo.addVertex(p.x, 0, p.z, 0, 1, 0);
+  }
+  for (agl::Index i = 1; i + 1 < hull.size(); ++i) {
+    m_shadow_geo.addIndex(0);
+    m_shadow_geo.addIndex(i);
+    m_shadow_geo.addIndex(i + 1);
+  }
+}
 
-    m_env.translate(m_px + 2.0, 0.01,
-                    m_pz + 2.0); // avoid z-fighting with the floor
-    // rotate the ship according to the facing direction
-    m_env.rotate(m_facing, m_viewUP);
-    // the Mesh is loaded on the other side
-    m_env.rotate(ENVOS_ANGLE, m_viewUP);
-    // rotate the ship acc. to steering val, to represent tilting
-    int sign = -1;
-    m_env.rotate(sign * m_steering, m_front_axis);
+// the mesh seen from above, white on transparent black, in the shadow map
+void Spaceship::renderSilhouette() {
+  auto &gl = m_env.gl();
+  const auto &lo = m_mesh->bbmin, &hi = m_mesh->bbmax;
+  float depth = m_mesh->radius() + 1.0f;
+
+  m_shadow_map.begin();
+  glClearColor(0, 0, 0, 0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  // looking down the Y axis: x to the right, -z upwards (v = 0 at hi.z)
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(lo.x, hi.x, -hi.z, -lo.z, -depth, depth);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glRotatef(90, 1, 0, 0);
+
+  gl.disable(GL_LIGHTING);
+  gl.disable(GL_TEXTURE_2D);
+  gl.disable(GL_BLEND);
+  m_env.setColor(agl::WHITE);
+  m_mesh->renderGouraud(false);
+  gl.enable(GL_LIGHTING);
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+
+  m_shadow_map.end();
+  glClearColor(agl::WHITE.r, agl::WHITE.g, agl::WHITE.b, agl::WHITE.a);
+}
 
-    m_env.scale(ENVOS_SCALE * 1.01, ENVOS_SCALE * 0.0,
-                ENVOS_SCALE * 1.01); // squash on Y, 1% scaling-up on X and Z
+void Spaceship::shadow(agl::RenderQueue &queue) {
+  if (m_shadow_mesh != m_mesh.get() ||
+      m_shadow_size != m_env.get_shadow_map_size()) {
+    buildShadow();
+  }
 
-    // render the ship without lighting and squashed!
-    m_mesh->renderGouraud(m_env.isWireframe());
-    m_env.enableLighting();
+  agl::Point3 center(m_px + 2.0, 0.01, m_pz + 2.0);
+  float scale = std::max(m_scaleX, m_scaleZ);
+  if (m_shadow_geo.empty() ||
+      !m_env.isVisible(center, scale * m_mesh->radius())) {
+    return;
+  }
+
+  // flat and dark: no lighting. The silhouette is blended on the floor
+  agl::Material material;
+  material.lighting = false;
+  material.geometry = &m_shadow_geo;
+  if (m_shadow_map.ready()) {
+    material.texture = m_shadow_map.texture();
+    material.textured = material.blend = true;
+  }
+
+  queue.submit(material, center, [this, center] {
+    m_env.mat_scope([&] {
+      m_env.setColor(agl::SHADOW);
+
+      // slightly above the floor, to avoid z-fighting
+      m_env.translate(center.x, center.y, center.z);
+      // same orientation as the ship, see transform()
+      m_env.rotate(m_facing, m_viewUP);
+      m_env.rotate(m_rotation_angle, m_viewUP);
+      int sign = m_rotation_angle == ENVOS_ANGLE ? -1 : 1;
+      m_env.rotate(sign * m_steering, m_front_axis);
+
+      // squash on Y, 1% scaling-up on X and Z
+      m_env.scale(m_scaleX * 1.01, 0.0, m_scaleZ * 1.01);
+
+      m_shadow_geo.draw();
+    });
   });
 }
 
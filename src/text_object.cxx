@@ -0,0 +1,64 @@
+#include "agl.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+/*
+ * TextObject: retained UI string. The quads are laid out by the font only
+ * when the text changes, and uploaded to a static buffer: an unchanged string
+ * costs one draw call and no allocations. See agl.h
+ */
+
+namespace agl {
+
+TextObject::TextObject()
+    : m_font(nullptr), m_x_o(0), m_y_o(0), m_end(0), m_vbo(GL_ARRAY_BUFFER) {}
+
+bool TextObject::set(AGLTextRenderer &font, int x_o, int y_o,
+                     const char *text) {
+  if (m_font == &font && m_x_o == x_o && m_y_o == y_o && m_text == text) {
+    return false;
+  }
+
+  m_font = &font;
+  m_x_o = x_o;
+  m_y_o = y_o;
+  m_text = text;
+
+  m_batch.clear();
+  m_end = font.layout(x_o, y_o, text, m_batch);
+  // without buffer objects, the quads are drawn from the batch
+  if (Buffer::supported()) {
+    m_vbo.upload(m_batch.quads.data(), m_batch.quads.size() * sizeof(GLfloat),
+                 GL_STATIC_DRAW);
+  }
+  return true;
+}
+
+bool TextObject::setf(AGLTextRenderer &font, int x_o, int y_o,
+                      const char *fmt, ...) {
+  char buf[256];
+  std::va_list ap;
+  va_start(ap, fmt);
+  std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+
+  return set(font, x_o, y_o, buf);
+}
+
+int TextObject::draw() {
+  if (!m_font) {
+    return m_x_o;
+  }
+
+  if (Buffer::supported()) {
+    m_vbo.bind();
+    m_font->drawBatch(m_batch, nullptr);
+    m_vbo.unbind();
+  } else {
+    m_font->drawBatch(m_batch, m_batch.quads.data());
+  }
+  return m_end;
+}
+
+} // namespace agl
@@ -45,6 +45,11 @@ const Color SHADOW = {.3f, .3f, .3f};
 
 static const auto PHYS_SAMPLING_STEP = 10U; // millisec of a Physics sim step
 static const auto FPS_SAMPLE = 10U;         // interval length
+static const auto CPU_TIME_REPORT = 5000U;  // millisec between CPU reports
+static const size_t PLANE_TILE_QUADS = 15U; // floor quads per culled tile
+// largest --shadow-map accepted: GL_MAX_TEXTURE_SIZE of current GPUs. The
+// actual limit can only be read once the context exists
+static const size_t SHADOW_MAP_MAX_SIZE = 16384U;
 } // namespace agl
 
 // GAME TYPES
@@ -54,6 +59,7 @@ static const auto RING_TIME = 7000U; // 8 secs
 static const auto BONUS_TIME = 5000U;
 static const auto FLAPPY_RING_TIME = 11000U; // 11 secs
 static const auto FLAPPY_BONUS_TIME = 7000U;
+static const auto RANKING_ENTRIES = 5U; // shown at the end of the game
 
 using Entry = std::pair<std::string, double>;
 
@@ -93,7 +99,7 @@ enum MouseEvent { MOTION, WHEEL };
 // LOGGING TYPES
 namespace lg {
 // logging levels
-enum Level { INFO, ERROR, PANIC };
+enum Level { INFO, WARNING, ERROR, PANIC };
 } // namespace lg
 
 // SPACESHIP TYPES
@@ -129,7 +135,12 @@ static const auto BOAT_ANGLE = 270;
 // ELEMENTS CONSTANTS
 namespace elements {
 static const auto FLOOR_SIZE = 120.0;
+// quads per side of the floor grid: more quads, smoother per-vertex lighting
+static const auto FLOOR_QUADS = 150U;
 static const auto SKY_RADIUS = 120.0;
+// sky dome tessellation: it's built once, so it can be smooth
+static const auto SKY_LATS = 64;
+static const auto SKY_LONGS = 64;
 static const auto DOOR_SCALE = 0.7;
 } // namespace elements
 